@@ -0,0 +1,43 @@
+#pragma once
+
+// system
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include <string>
+
+
+static inline uint64_t bench_now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+// run f() repeatedly for at least min_ns, report the per call time and throughput
+template <class F>
+static inline void bench_run(const char *name, size_t bytes, F f, uint64_t min_ns = 200000000ULL) {
+    f();    // warm up
+    uint64_t rounds = 0;
+    uint64_t begin = bench_now_ns();
+    uint64_t elapsed = 0;
+    do {
+        f();
+        rounds++;
+        elapsed = bench_now_ns() - begin;
+    } while (elapsed < min_ns);
+
+    double ns = (double)elapsed / (double)rounds;
+    if (bytes > 0) {
+        printf("%-40s %12.0f ns/op %10.1f MB/s\n", name, ns, (double)bytes / ns * 1e3);
+    } else {
+        printf("%-40s %12.0f ns/op\n", name, ns);
+    }
+}
+
+// prevent the optimizer from dropping a result
+static const void *volatile g_bench_sink;
+
+template <class T>
+static inline void bench_keep(const T &val) {
+    g_bench_sink = &val;
+}
@@ -0,0 +1,89 @@
+// system
+#include <malloc.h>
+#include <stdlib.h>
+#include <string>
+// proj
+#include "../j/j.h"
+#include "bench.h"
+
+
+static size_t heap_bytes() {
+    struct mallinfo2 mi = mallinfo2();
+    return mi.uordblks + mi.hblkhd;
+}
+
+static std::string gen_ints(size_t n) {
+    std::string ans = "[";
+    char buf[32];
+    for (size_t i = 0; i < n; ++i) {
+        snprintf(buf, sizeof(buf), "%s%zu", i ? "," : "", i * 7 % 1000);
+        ans += buf;
+    }
+    ans.push_back(']');
+    return ans;
+}
+
+int main() {
+    size_t n = 10000000;
+    j::Doc doc;
+    j::ArrayResult arr = doc.set_arr();
+    for (size_t i = 0; i < n; ++i) {
+        arr.push_back().set_u64(i);
+    }
+    j::ConstArrayResult carr = doc.get_arr();
+    bench_run("scan 10M u64", n * 16, [&]() {
+        uint64_t sum = 0;
+        for (size_t i = 0; i < n; ++i) {
+            sum += carr.at(i).get_u64(0);
+        }
+        bench_keep(sum);
+    });
+
+    bench_run("push_back 1M", 0, [&]() {
+        j::Doc doc;
+        j::ArrayResult arr = doc.set_arr();
+        for (size_t i = 0; i < 1000000; ++i) {
+            arr.push_back().set_u64(i);
+        }
+    });
+    bench_run("reserve+push_back 1M", 0, [&]() {
+        j::Doc doc;
+        j::ArrayResult arr = doc.set_arr();
+        arr.reserve(1000000);
+        for (size_t i = 0; i < 1000000; ++i) {
+            arr.push_back().set_u64(i);
+        }
+    });
+
+    bench_run("erase front 1000 of 100000", 0, [&]() {
+        j::Doc doc;
+        j::ArrayResult arr = doc.set_arr();
+        for (size_t i = 0; i < 100000; ++i) {
+            arr.push_back().set_u64(i);
+        }
+        for (size_t i = 0; i < 1000; ++i) {
+            arr.erase(0);
+        }
+    });
+
+    std::string input = gen_ints(1000000);
+    bench_run("parse 1M ints", input.size(), [&]() {
+        j::Doc doc;
+        j::Parser().parse(input, doc);
+    });
+    std::string nested = "[";
+    for (size_t i = 0; i < 100000; ++i) {
+        nested += i ? ",[1,2,3,[4,5]]" : "[1,2,3,[4,5]]";
+    }
+    nested += "]";
+    bench_run("parse 100000 small arrays", nested.size(), [&]() {
+        j::Doc doc;
+        j::Parser().parse(nested, doc);
+    });
+
+    size_t before = heap_bytes();
+    j::Doc parsed;
+    j::Parser().parse(nested, parsed);
+    printf("%-40s %12zu bytes\n", "memory of 100000 small arrays", heap_bytes() - before);
+    return 0;
+}
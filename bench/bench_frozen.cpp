@@ -0,0 +1,117 @@
+// system
+#include <stdlib.h>
+// proj
+#include "../j/j.h"
+#include "bench.h"
+
+
+static std::string gen_records(size_t n) {
+    std::string ans = "[";
+    char buf[256];
+    for (size_t i = 0; i < n; ++i) {
+        snprintf(buf, sizeof(buf),
+            "%s{\"id\":%zu,\"name\":\"user%zu\",\"active\":%s,\"score\":%zu.5,\"tags\":[\"a\",\"b\"]}",
+            i ? "," : "", i, i, (i & 1) ? "true" : "false", i % 100);
+        ans += buf;
+    }
+    ans.push_back(']');
+    return ans;
+}
+
+// the read-only workload: sum the ids, the active scores and the lengths of names
+template <class Arr, class Map, class It>
+static double walk(const Arr &arr) {
+    double sum = 0;
+    It it = arr.iter();
+    while (it.next()) {
+        Map rec = it.value().get_map();
+        sum += rec.key("id").get_u64(0);
+        if (rec.key("active").get_bool(false)) {
+            sum += rec.key("score").get_double(0);
+        }
+        sum += rec.key("name").get_str("").size();
+    }
+    return sum;
+}
+
+// ConstArrayResult has no iterator
+struct DocArrayIter {
+    j::ConstArrayResult arr;
+    size_t i;
+
+    bool next() {
+        return ++i < arr.size();
+    }
+    j::ConstNodeResult value() const {
+        return arr.at(i);
+    }
+};
+
+struct DocArray {
+    j::ConstArrayResult arr;
+
+    DocArrayIter iter() const {
+        DocArrayIter it;
+        it.arr = arr;
+        it.i = ~size_t(0);
+        return it;
+    }
+};
+
+static void bench_records(size_t n) {
+    std::string input = gen_records(n);
+    char name[64];
+    j::Parser parser;
+
+    j::Doc doc;
+    snprintf(name, sizeof(name), "Doc parse %zu records", n);
+    bench_run(name, input.size(), [&]() {
+        parser.parse(input, doc);
+    });
+    j::FrozenDoc frozen;
+    snprintf(name, sizeof(name), "FrozenDoc parse %zu records", n);
+    bench_run(name, input.size(), [&]() {
+        parser.parse(input, frozen);
+    });
+
+    DocArray arr;
+    arr.arr = doc.get_arr();
+    snprintf(name, sizeof(name), "Doc walk %zu records", n);
+    bench_run(name, input.size(), [&]() {
+        bench_keep(walk<DocArray, j::ConstMapResult, DocArrayIter>(arr));
+    });
+    j::FrozenArrayResult farr = frozen.get_root().get_arr();
+    snprintf(name, sizeof(name), "FrozenDoc walk %zu records", n);
+    bench_run(name, input.size(), [&]() {
+        bench_keep(walk<j::FrozenArrayResult, j::FrozenMapResult, j::FrozenArrayIterator>(farr));
+    });
+
+    j::Dumper dumper;
+    snprintf(name, sizeof(name), "Doc dump %zu records", n);
+    bench_run(name, input.size(), [&]() {
+        bench_keep(dumper.dump(doc));
+    });
+    snprintf(name, sizeof(name), "FrozenDoc dump %zu records", n);
+    bench_run(name, input.size(), [&]() {
+        bench_keep(dumper.dump(frozen));
+    });
+
+    snprintf(name, sizeof(name), "Doc parse+drop %zu records", n);
+    bench_run(name, input.size(), [&]() {
+        j::Doc tmp;
+        parser.parse(input, tmp);
+    });
+    snprintf(name, sizeof(name), "FrozenDoc parse+drop %zu records", n);
+    bench_run(name, input.size(), [&]() {
+        j::FrozenDoc tmp;
+        parser.parse(input, tmp);
+    });
+
+    printf("%-40s %12zu bytes %10zu bytes FrozenDoc\n", "memory", doc.memory_usage(), frozen.memory_usage());
+}
+
+int main() {
+    bench_records(10);
+    bench_records(10000);
+    return 0;
+}
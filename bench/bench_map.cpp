@@ -0,0 +1,142 @@
+// system
+#include <stdlib.h>
+#include <vector>
+// proj
+#include "../j/j.h"
+#include "bench.h"
+
+
+static std::vector<std::string> gen_keys(size_t n) {
+    std::vector<std::string> keys;
+    char buf[64];
+    for (size_t i = 0; i < n; ++i) {
+        snprintf(buf, sizeof(buf), "field_%zu_%zx", i, i * 2654435761u % 65521);
+        keys.push_back(buf);
+    }
+    return keys;
+}
+
+static void bench_keys(size_t n) {
+    std::vector<std::string> keys = gen_keys(n);
+    // the same number of operations for each size
+    size_t rounds = 100000 / n + 1;
+    char name[64];
+
+    snprintf(name, sizeof(name), "insert %zu keys x %zu", n, rounds);
+    bench_run(name, 0, [&]() {
+        for (size_t r = 0; r < rounds; ++r) {
+            j::Doc doc;
+            j::MapResult m = doc.set_map();
+            for (size_t i = 0; i < n; ++i) {
+                m.key(keys[i].c_str()).set_null();
+            }
+        }
+    });
+
+    j::Doc doc;
+    j::MapResult m = doc.set_map();
+    for (size_t i = 0; i < n; ++i) {
+        m.key(keys[i].c_str()).set_u64(i);
+    }
+    j::ConstMapResult cm = doc.get_map();
+
+    snprintf(name, sizeof(name), "lookup %zu keys x %zu", n, rounds);
+    bench_run(name, 0, [&]() {
+        uint64_t sum = 0;
+        for (size_t r = 0; r < rounds; ++r) {
+            for (size_t i = 0; i < n; ++i) {
+                sum += cm.key(keys[i].c_str()).get_u64(0);
+            }
+        }
+        bench_keep(sum);
+    });
+
+    snprintf(name, sizeof(name), "lookup miss %zu keys x %zu", n, rounds);
+    bench_run(name, 0, [&]() {
+        size_t found = 0;
+        for (size_t r = 0; r < rounds; ++r) {
+            for (size_t i = 0; i < n; ++i) {
+                found += cm.key("no_such_field").ok();
+            }
+        }
+        bench_keep(found);
+    });
+
+    std::string input = j::Dumper().dump(doc);
+    snprintf(name, sizeof(name), "parse %zu keys", n);
+    bench_run(name, input.size(), [&]() {
+        j::Doc doc;
+        j::Parser().parse(input, doc);
+    });
+}
+
+// array of records with the same keys
+static void bench_records(size_t nkeys, size_t n) {
+    std::vector<std::string> keys = gen_keys(nkeys);
+    std::string input = "[";
+    for (size_t r = 0; r < n; ++r) {
+        input += r ? ",{" : "{";
+        for (size_t i = 0; i < nkeys; ++i) {
+            char buf[32];
+            snprintf(buf, sizeof(buf), "%s\"%s\":%zu", i ? "," : "", keys[i].c_str(), r + i);
+            input += buf;
+        }
+        input += "}";
+    }
+    input += "]";
+    char name[64];
+
+    snprintf(name, sizeof(name), "parse %zu records of %zu keys", n, nkeys);
+    bench_run(name, input.size(), [&]() {
+        j::Doc doc;
+        j::Parser().parse(input, doc);
+    });
+
+    j::Doc doc;
+    j::Parser().parse(input, doc);
+    j::ConstArrayResult arr = doc.get_arr();
+    snprintf(name, sizeof(name), "lookup %zu records of %zu keys", n, nkeys);
+    bench_run(name, 0, [&]() {
+        uint64_t sum = 0;
+        for (size_t r = 0; r < n; ++r) {
+            j::ConstMapResult cm = arr.at(r).get_map();
+            for (size_t i = 0; i < nkeys; ++i) {
+                sum += cm.key(keys[i].c_str()).get_u64(0);
+            }
+        }
+        bench_keep(sum);
+    });
+}
+
+// array of maps keyed by ids, no two maps share a key
+static void bench_id_maps(size_t nkeys, size_t n) {
+    std::string input = "[";
+    for (size_t r = 0; r < n; ++r) {
+        input += r ? ",{" : "{";
+        for (size_t i = 0; i < nkeys; ++i) {
+            char buf[48];
+            snprintf(buf, sizeof(buf), "%s\"u%zu\":%zu", i ? "," : "", r * nkeys + i, i);
+            input += buf;
+        }
+        input += "}";
+    }
+    input += "]";
+    char name[64];
+
+    snprintf(name, sizeof(name), "parse %zu id maps of %zu keys", n, nkeys);
+    bench_run(name, input.size(), [&]() {
+        j::Doc doc;
+        j::Parser().parse(input, doc);
+    });
+}
+
+int main() {
+    bench_keys(4);
+    bench_keys(32);
+    bench_keys(10000);
+    bench_records(6, 10000);
+    bench_records(32, 10000);
+    bench_id_maps(1, 40000);
+    bench_id_maps(20, 1000);
+    return 0;
+}
@@ -0,0 +1,222 @@
+// system
+#include <malloc.h>
+#include <stdlib.h>
+// proj
+#include "../j/j.h"
+#include "bench.h"
+
+
+// heap bytes currently in use
+static size_t heap_bytes() {
+    struct mallinfo2 mi = mallinfo2();
+    return mi.uordblks + mi.hblkhd;
+}
+
+
+static std::string gen_scalars(size_t n) {
+    std::string ans = "[";
+    for (size_t i = 0; i < n; ++i) {
+        if (i) {
+            ans.push_back(',');
+        }
+        ans += (i % 3 == 0) ? "true" : (i % 3 == 1) ? "null" : "7";
+    }
+    ans.push_back(']');
+    return ans;
+}
+
+static std::string gen_numbers(size_t n) {
+    std::string ans = "[";
+    char buf[32];
+    for (size_t i = 0; i < n; ++i) {
+        snprintf(buf, sizeof(buf), "%s%zu", i ? "," : "", i * 7919 % 1000003);
+        ans += buf;
+    }
+    ans.push_back(']');
+    return ans;
+}
+
+static std::string gen_records(size_t n) {
+    std::string ans = "[";
+    char buf[256];
+    for (size_t i = 0; i < n; ++i) {
+        snprintf(buf, sizeof(buf),
+            "%s{\"id\":%zu,\"name\":\"user%zu\",\"active\":%s,\"score\":%zu.5,\"tags\":[\"a\",\"b\"]}",
+            i ? "," : "", i, i, (i & 1) ? "true" : "false", i % 100);
+        ans += buf;
+    }
+    ans.push_back(']');
+    return ans;
+}
+
+// records with long strings, escaped in 1/8
+static std::string gen_texts(size_t n) {
+    std::string ans = "[";
+    char buf[512];
+    for (size_t i = 0; i < n; ++i) {
+        snprintf(buf, sizeof(buf),
+            "%s{\"id\":%zu,\"title\":\"Lorem ipsum dolor sit amet %zu\","
+            "\"body\":\"consectetur adipiscing elit, sed do eiusmod tempor incididunt ut labore%s"
+            " et dolore magna aliqua. Ut enim ad minim veniam, quis nostrud exercitation\"}",
+            i ? "," : "", i, i, (i % 8 == 0) ? "\\n" : "");
+        ans += buf;
+    }
+    ans.push_back(']');
+    return ans;
+}
+
+// number of values in the tree, including containers
+static size_t count_nodes(j::ConstNodeResult node) {
+    size_t n = 1;
+    if (node.is_arr()) {
+        j::ConstArrayResult arr = node.get_arr();
+        for (size_t i = 0; i < arr.size(); ++i) {
+            n += count_nodes(arr.at(i));
+        }
+    } else if (node.is_map()) {
+        j::ConstMapIterator it = node.get_map().iter();
+        while (it.next()) {
+            n += count_nodes(it.value());
+        }
+    }
+    return n;
+}
+
+static void measure(const char *name, const std::string &input) {
+    size_t before = heap_bytes();
+    j::Doc doc;
+    if (!j::Parser().parse(input, doc)) {
+        printf("%s: parse error\n", name);
+        exit(1);
+    }
+    size_t used = heap_bytes() - before;
+    size_t nodes = count_nodes(doc.get_root());
+    printf("%-24s %10zu nodes %12zu bytes %8.1f bytes/node %6.2f x input\n",
+        name, nodes, used, (double)used / nodes, (double)used / input.size());
+
+    uint64_t ts = bench_now_ns();
+    j::MemoryStats st = doc.memory_stats();
+    uint64_t te = bench_now_ns();
+    printf("%-24s %10zu usage %12zu stats bytes %8zu slack %6.1f ns/node to walk\n",
+        "", doc.memory_usage(), st.bytes, st.slack, (double)(te - ts) / nodes);
+
+    uint64_t t0 = bench_now_ns();
+    doc.clear();
+    uint64_t t1 = bench_now_ns();
+    printf("%-24s %10.1f ns/node to free\n", "", (double)(t1 - t0) / nodes);
+}
+
+// a request handler parses and drops a document per request
+static void parse_drop(const char *name, const std::string &input) {
+    bench_run(name, input.size(), [&]() {
+        j::Doc doc;
+        j::Parser().parse(input, doc);
+    });
+}
+
+// parse into the same Doc, the memory is reused
+static void parse_reuse(const char *name, const std::string &input, bool borrow) {
+    j::Doc doc;
+    j::Parser parser;
+    parser.borrow_input = borrow;
+    bench_run(name, input.size(), [&]() {
+        parser.parse(input, doc);
+    });
+}
+
+// a long-lived document with key churn
+static void churn(const char *name, size_t nkeys, size_t rounds) {
+    size_t before = heap_bytes();
+    j::Doc doc;
+    j::MapResult m = doc.set_map();
+    char key[32];
+    for (size_t i = 0; i < nkeys; ++i) {
+        snprintf(key, sizeof(key), "session%zu", i);
+        m.key(key).set_u64(i);
+    }
+    uint64_t x = 88172645463325252ULL;
+    uint64_t t0 = bench_now_ns();
+    for (size_t r = 0; r < rounds; ++r) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        snprintf(key, sizeof(key), "session%zu", (size_t)(x % nkeys));
+        m.erase(key);
+        m.key(key).set_u64(r);
+    }
+    uint64_t t1 = bench_now_ns();
+    size_t used = heap_bytes() - before;
+    doc.shrink();
+    size_t shrinked = heap_bytes() - before;
+    printf("%-24s %10zu keys %12zu bytes %8zu bytes after shrink %6.1f ns/round\n",
+        name, nkeys, used, shrinked, (double)(t1 - t0) / rounds);
+}
+
+// documents built from a shared template, with a small change each
+static void graft(const char *name, const std::string &input, size_t rounds) {
+    j::Doc tpl;
+    j::Parser().parse(input, tpl);
+    size_t before = heap_bytes();
+    size_t used = 0;
+    uint64_t t0 = bench_now_ns();
+    for (size_t r = 0; r < rounds; ++r) {
+        j::Doc doc;
+        j::MapResult m = doc.set_map();
+        m.key("id").set_u64(r);
+        m.key("body").set(tpl.get_root());
+        m.key("body").set_arr().at(r % 10).set_map().key("id").set_u64(r);
+        used += heap_bytes() - before;
+    }
+    uint64_t t1 = bench_now_ns();
+    printf("%-24s %10zu rounds %12zu bytes/doc %6.1f us/round\n",
+        name, rounds, used / rounds, (double)(t1 - t0) / rounds / 1000);
+}
+
+// fragments built separately, put into one document by set() or adopt(), then modified
+static void assemble(const char *name, const std::string &input, size_t nparts, bool adopt) {
+    size_t before = heap_bytes();
+    j::Doc *parts = new j::Doc[nparts];
+    for (size_t i = 0; i < nparts; ++i) {
+        j::Parser().parse(input, parts[i]);
+    }
+    uint64_t t0 = bench_now_ns();
+    j::Doc doc;
+    j::ArrayResult arr = doc.set_arr();
+    for (size_t i = 0; i < nparts; ++i) {
+        if (adopt) {
+            arr.push_back().adopt(parts[i]);
+        } else {
+            arr.push_back().set(parts[i].get_root());
+        }
+    }
+    delete[] parts;
+    for (size_t i = 0; i < nparts; ++i) {
+        arr.at(i).set_arr().push_back().set_u64(i);
+    }
+    uint64_t t1 = bench_now_ns();
+    printf("%-24s %10zu parts %12zu bytes %6.1f us/part\n",
+        name, nparts, heap_bytes() - before, (double)(t1 - t0) / nparts / 1000);
+}
+
+int main() {
+    measure("scalars", gen_scalars(1000000));
+    measure("numbers", gen_numbers(1000000));
+    measure("records", gen_records(100000));
+
+    parse_drop("parse+drop small records", gen_records(10));
+    parse_drop("parse+drop large records", gen_records(10000));
+    parse_reuse("parse+reuse small records", gen_records(10), false);
+    parse_reuse("parse+reuse large records", gen_records(10000), false);
+    parse_reuse("parse+reuse texts", gen_texts(10000), false);
+    parse_reuse("parse+borrow texts", gen_texts(10000), true);
+
+    churn("churn small map", 10, 1000000);
+    churn("churn large map", 10000, 1000000);
+
+    graft("graft small template", gen_records(10), 100000);
+    graft("graft large template", gen_records(10000), 1000);
+
+    assemble("assemble by set", gen_records(1000), 100, false);
+    assemble("assemble by adopt", gen_records(1000), 100, true);
+    return 0;
+}
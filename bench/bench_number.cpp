@@ -0,0 +1,214 @@
+// system
+#include <stdlib.h>
+#include <string>
+#include <vector>
+// proj
+#include "../j/j.h"
+#include "../j/j_quick.h"
+#include "bench.h"
+
+
+static std::string gen_ints(size_t n) {
+    std::string ans = "[";
+    char buf[64];
+    uint64_t x = 88172645463325252ULL;
+    for (size_t i = 0; i < n; ++i) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        snprintf(buf, sizeof(buf), "%s%lld", i ? "," : "", (long long)(x % 2000000) - 1000000);
+        ans += buf;
+    }
+    ans.push_back(']');
+    return ans;
+}
+
+static std::string gen_floats(size_t n) {
+    std::string ans = "[";
+    char buf[64];
+    uint64_t x = 88172645463325252ULL;
+    for (size_t i = 0; i < n; ++i) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        snprintf(buf, sizeof(buf), "%s%.17g", i ? "," : "", (double)(x >> 11) / (double)(1ULL << 40));
+        ans += buf;
+    }
+    ans.push_back(']');
+    return ans;
+}
+
+// [lon, lat] pairs with 6 decimals, like GeoJSON
+static std::string gen_coords(size_t n) {
+    std::string ans = "[";
+    char buf[64];
+    uint64_t x = 88172645463325252ULL;
+    for (size_t i = 0; i < n; ++i) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        snprintf(buf, sizeof(buf), "%s[%.6f,%.6f]", i ? "," : "",
+            (double)(x % 360000000) / 1e6 - 180, (double)((x >> 32) % 180000000) / 1e6 - 90);
+        ans += buf;
+    }
+    ans.push_back(']');
+    return ans;
+}
+
+// records of timestamps, counters and gauges
+static std::string gen_metrics(size_t n) {
+    std::string ans = "[";
+    char buf[256];
+    uint64_t x = 88172645463325252ULL;
+    for (size_t i = 0; i < n; ++i) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        snprintf(buf, sizeof(buf),
+            "%s{\"ts\":%llu,\"cpu\":%.2f,\"mem\":%llu,\"rps\":%.1f,\"p99\":%.3f,\"errors\":%llu}",
+            i ? "," : "", 1700000000000ULL + i * 1000, (double)(x % 10000) / 100,
+            (unsigned long long)(x % 17179869184ULL), (double)(x % 100000) / 10,
+            (double)((x >> 20) % 1000000) / 1000, (unsigned long long)(x % 7));
+        ans += buf;
+    }
+    ans.push_back(']');
+    return ans;
+}
+
+static void bench_parse(const char *kind, const std::string &input) {
+    char name[64];
+    j::Parser parser;
+    j::Doc doc;
+    snprintf(name, sizeof(name), "parse %s", kind);
+    bench_run(name, input.size(), [&]() {
+        parser.parse(input, doc);
+    });
+
+    j::FrozenDoc frozen;
+    snprintf(name, sizeof(name), "FrozenDoc parse %s", kind);
+    bench_run(name, input.size(), [&]() {
+        parser.parse(input, frozen);
+    });
+}
+
+static void bench_numbers(const char *kind, const std::string &input) {
+    char name[64];
+    snprintf(name, sizeof(name), "parse %s", kind);
+    bench_run(name, input.size(), [&]() {
+        j::Doc doc;
+        j::Parser().parse(input, doc);
+    });
+
+    j::Doc doc;
+    j::Parser().parse(input, doc);
+    j::ConstArrayResult arr = doc.get_arr();
+    size_t n = arr.size();
+
+    snprintf(name, sizeof(name), "get_i64 %zu %s", n, kind);
+    bench_run(name, 0, [&]() {
+        int64_t sum = 0;
+        for (size_t i = 0; i < n; ++i) {
+            sum += arr.at(i).get_i64(0);
+        }
+        bench_keep(sum);
+    });
+
+    snprintf(name, sizeof(name), "get_double %zu %s", n, kind);
+    bench_run(name, 0, [&]() {
+        double sum = 0;
+        for (size_t i = 0; i < n; ++i) {
+            sum += arr.at(i).get_double(0);
+        }
+        bench_keep(sum);
+    });
+
+    // the conversion of the parser, against the libc
+    std::vector<std::string> texts;
+    size_t bytes = 0;
+    for (size_t i = 0; i < n; ++i) {
+        texts.push_back(arr.at(i).get_number(""));
+        bytes += texts.back().size();
+    }
+    snprintf(name, sizeof(name), "__parse_double %zu %s", n, kind);
+    bench_run(name, bytes, [&]() {
+        double sum = 0;
+        for (size_t i = 0; i < n; ++i) {
+            double d = 0;
+            j::__parse_double(texts[i], &d);
+            sum += d;
+        }
+        bench_keep(sum);
+    });
+    snprintf(name, sizeof(name), "strtod %zu %s", n, kind);
+    bench_run(name, bytes, [&]() {
+        double sum = 0;
+        for (size_t i = 0; i < n; ++i) {
+            sum += strtod(texts[i].c_str(), NULL);
+        }
+        bench_keep(sum);
+    });
+
+    snprintf(name, sizeof(name), "extract int32 %zu %s", n, kind);
+    bench_run(name, 0, [&]() {
+        int64_t sum = 0;
+        for (size_t i = 0; i < n; ++i) {
+            int32_t v = 0;
+            j::extract(arr.at(i), v);
+            sum += v;
+        }
+        bench_keep(sum);
+    });
+
+    snprintf(name, sizeof(name), "dump %s", kind);
+    bench_run(name, input.size(), [&]() {
+        bench_keep(j::Dumper().dump(doc));
+    });
+
+    // the formatting of the doubles
+    std::vector<double> values;
+    for (size_t i = 0; i < n; ++i) {
+        values.push_back(arr.at(i).get_double(0));
+    }
+    snprintf(name, sizeof(name), "set_double & dump %zu %s", n, kind);
+    bench_run(name, 0, [&]() {
+        j::Doc out;
+        j::ArrayResult out_arr = out.set_arr();
+        for (size_t i = 0; i < n; ++i) {
+            out_arr.push_back().set_double(values[i]);
+        }
+        bench_keep(j::Dumper().dump(out));
+    });
+}
+
+// set_i64() and the formatting on dump
+static void bench_set_ints(const char *kind, uint64_t mask, size_t n) {
+    std::vector<int64_t> values;
+    uint64_t x = 88172645463325252ULL;
+    for (size_t i = 0; i < n; ++i) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        values.push_back((int64_t)(x & mask));
+    }
+
+    char name[64];
+    snprintf(name, sizeof(name), "set_i64 & dump %zu %s", n, kind);
+    bench_run(name, 0, [&]() {
+        j::Doc doc;
+        j::ArrayResult arr = doc.set_arr();
+        for (size_t i = 0; i < n; ++i) {
+            arr.push_back().set_i64(values[i]);
+        }
+        bench_keep(j::Dumper().dump(doc));
+    });
+}
+
+int main() {
+    bench_numbers("ints", gen_ints(100000));
+    bench_numbers("floats", gen_floats(100000));
+    bench_parse("coords", gen_coords(100000));
+    bench_parse("metrics", gen_metrics(20000));
+    bench_set_ints("counters", 0xffff, 10000000);
+    bench_set_ints("ids", ~0ULL, 10000000);
+    return 0;
+}
@@ -0,0 +1,187 @@
+// system
+#include <stdlib.h>
+#include <glob.h>
+#include <vector>
+// proj
+#include "../j/j.h"
+#include "bench.h"
+
+
+// records nested a few levels deep, so that the indented form has long runs of spaces
+static std::string gen_nested(size_t n) {
+    std::string ans = "[";
+    char buf[512];
+    for (size_t i = 0; i < n; ++i) {
+        snprintf(buf, sizeof(buf),
+            "%s{\"id\":%zu,\"name\":\"user%zu\",\"active\":%s,"
+            "\"profile\":{\"score\":%zu.5,\"tags\":[\"a\",\"b\",\"c\"],"
+            "\"address\":{\"city\":\"city%zu\",\"zip\":\"%05zu\",\"geo\":[%zu,%zu]}}}",
+            i ? "," : "", i, i, (i & 1) ? "true" : "false", i % 100, i % 50, i, i % 90, i % 180);
+        ans += buf;
+    }
+    ans.push_back(']');
+    return ans;
+}
+
+// log messages and base64 blobs
+static std::string gen_texts(size_t n) {
+    static const char k_b64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    std::string ans = "[";
+    char buf[256];
+    for (size_t i = 0; i < n; ++i) {
+        snprintf(buf, sizeof(buf),
+            "%s{\"level\":\"info\",\"msg\":\"request %zu from 10.0.%zu.%zu finished in %zu ms, "
+            "upstream=backend-%zu, path=/api/v1/items/%zu?expand=true&fields=id,name,tags\",\"blob\":\"",
+            i ? "," : "", i, i % 256, i % 100, i % 1000, i % 8, i);
+        ans += buf;
+        for (size_t k = 0; k < 1024; ++k) {
+            ans.push_back(k_b64[(i * 7 + k * 13) % 64]);
+        }
+        ans += "\"}";
+    }
+    ans.push_back(']');
+    return ans;
+}
+
+// the messages in other languages, mostly non-ASCII
+static std::string gen_utf8_texts(size_t n) {
+    static const char *const k_words[] = {
+        "\xe4\xbd\xa0\xe5\xa5\xbd", "\xe4\xb8\x96\xe7\x95\x8c", "caf\xc3\xa9", "\xd0\xbf\xd1\x80\xd0\xb8\xd0\xb2\xd0\xb5\xd1\x82",
+        "\xe3\x81\x93\xe3\x82\x93\xe3\x81\xab\xe3\x81\xa1\xe3\x81\xaf", "\xf0\x9f\x98\x80", "stra\xc3\x9f""e", "\xce\xb1\xce\xb2\xce\xb3",
+    };
+    std::string ans = "[";
+    for (size_t i = 0; i < n; ++i) {
+        ans += i ? ",{\"msg\":\"" : "{\"msg\":\"";
+        for (size_t k = 0; k < 100; ++k) {
+            ans += k_words[(i * 7 + k * 13) % 8];
+            ans.push_back(' ');
+        }
+        ans += "\"}";
+    }
+    ans.push_back(']');
+    return ans;
+}
+
+// [{"a":[{"a":...}]}] repeated, 2 * depth levels each
+static std::string gen_deep(size_t n, size_t depth) {
+    std::string ans = "[";
+    for (size_t i = 0; i < n; ++i) {
+        if (i) {
+            ans.push_back(',');
+        }
+        for (size_t k = 0; k < depth; ++k) {
+            ans += "[{\"a\":";
+        }
+        ans += "1";
+        for (size_t k = 0; k < depth; ++k) {
+            ans += "}]";
+        }
+    }
+    ans.push_back(']');
+    return ans;
+}
+
+static void bench_parse(const char *what, const std::string &input) {
+    j::Parser parser;
+    j::Doc doc;
+    char name[64];
+    snprintf(name, sizeof(name), "Doc parse %s", what);
+    bench_run(name, input.size(), [&]() {
+        parser.parse(input, doc);
+    });
+
+    parser.structural_index = true;
+    snprintf(name, sizeof(name), "Doc parse indexed %s", what);
+    bench_run(name, input.size(), [&]() {
+        parser.parse(input, doc);
+    });
+    parser.structural_index = false;
+
+    parser.validate_string = true;
+    snprintf(name, sizeof(name), "Doc parse validated %s", what);
+    bench_run(name, input.size(), [&]() {
+        parser.parse(input, doc);
+    });
+    parser.structural_index = true;
+    snprintf(name, sizeof(name), "Doc parse indexed validated %s", what);
+    bench_run(name, input.size(), [&]() {
+        parser.parse(input, doc);
+    });
+    parser.structural_index = false;
+    parser.validate_string = false;
+
+    j::FrozenDoc frozen;
+    snprintf(name, sizeof(name), "FrozenDoc parse %s", what);
+    bench_run(name, input.size(), [&]() {
+        parser.parse(input, frozen);
+    });
+}
+
+static std::vector<std::string> read_files(const char *pattern) {
+    std::vector<std::string> ans;
+    glob_t gset;
+    if (0 != glob(pattern, 0, NULL, &gset)) {
+        return ans;
+    }
+    for (size_t i = 0; i < gset.gl_pathc; ++i) {
+        std::string data;
+        FILE *fp = fopen(gset.gl_pathv[i], "rb");
+        char buf[4096];
+        size_t n = 0;
+        while (fp && (n = fread(buf, 1, sizeof(buf), fp)) > 0) {
+            data.append(buf, n);
+        }
+        if (fp) {
+            fclose(fp);
+        }
+        ans.push_back(data);
+    }
+    globfree(&gset);
+    return ans;
+}
+
+// the whole corpus per op
+static void bench_corpus(const char *what, const char *pattern) {
+    std::vector<std::string> inputs = read_files(pattern);
+    size_t bytes = 0;
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        bytes += inputs[i].size();
+    }
+    j::Parser parser;
+    j::Doc doc;
+    char name[64];
+    snprintf(name, sizeof(name), "Doc parse %s %zu files", what, inputs.size());
+    bench_run(name, bytes, [&]() {
+        for (size_t i = 0; i < inputs.size(); ++i) {
+            parser.parse(inputs[i], doc);
+        }
+    });
+}
+
+int main() {
+    std::string minified = gen_nested(10000);
+    j::Parser parser;
+    j::Doc doc;
+    if (!parser.parse(minified, doc)) {
+        abort();
+    }
+
+    j::Dumper dumper;
+    bench_parse("minified", minified);
+    dumper.spacing = true;
+    bench_parse("spacing", dumper.dump(doc));
+    dumper.indent = 2;
+    bench_parse("indent 2", dumper.dump(doc));
+    dumper.indent = 4;
+    bench_parse("indent 4", dumper.dump(doc));
+
+    bench_parse("texts", gen_texts(1000));
+    bench_parse("utf-8 texts", gen_utf8_texts(1000));
+    bench_parse("depth 40", gen_deep(10000, 20));
+    bench_parse("depth 2000", gen_deep(200, 1000));
+
+    // the rejected inputs against the accepted ones
+    bench_corpus("JSONTestSuite n_", "./submodules/JSONTestSuite/test_parsing/n_*.json");
+    bench_corpus("JSONTestSuite y_", "./submodules/JSONTestSuite/test_parsing/y_*.json");
+    return 0;
+}
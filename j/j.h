@@ -16,9 +16,71 @@ namespace j {
     struct MapResult;
     struct ConstMapIterator;
     struct MapIterator;
+    struct Doc;
+    struct FrozenDoc;
+    struct FrozenArrayResult;
+    struct FrozenMapResult;
 
     struct _Node;
+    struct _Arena;
     struct _MovingNode;
+    struct _Link;
+
+    // The memory of Doc and FrozenDoc is obtained from an allocator, malloc_allocator() by default.
+    // NOTE: the allocator must outlive the documents using it, and the Docs sharing their containers.
+    // NOTE: the std::string returned by the readers, the dumper and the parser errors use the global one.
+    struct Allocator {
+        virtual ~Allocator() {}
+        // NULL if out of memory
+        virtual void *allocate(size_t size) = 0;
+        // resize p of size bytes, NULL if out of memory and p is kept
+        virtual void *reallocate(void *p, size_t size, size_t nsize) = 0;
+        virtual void deallocate(void *p, size_t size) = 0;
+    };
+
+    Allocator *malloc_allocator();
+
+    // counts the memory obtained from base, allocations beyond the limit fail
+    struct CountingAllocator : Allocator {
+        explicit CountingAllocator(Allocator *base = malloc_allocator(), size_t limit = ~size_t(0))
+            : base(base), limit(limit), count(0), bytes(0), peak(0), calls(0)
+        {}
+        virtual void *allocate(size_t size);
+        virtual void *reallocate(void *p, size_t size, size_t nsize);
+        virtual void deallocate(void *p, size_t size);
+
+        Allocator *base;
+        size_t limit;   // of bytes
+        size_t count;   // live allocations
+        size_t bytes;   // live bytes
+        size_t peak;    // max of bytes
+        size_t calls;   // allocate() and reallocate() called
+
+    private:
+        CountingAllocator(const CountingAllocator &);
+        CountingAllocator &operator=(const CountingAllocator &);
+    };
+
+    // the footprint of a tree, see _NodeReader::memory_stats()
+    struct MemoryStats {
+        size_t bytes;           // nodes, containers, key indexes and texts, excluding the keys shared by maps
+        // number of values by type
+        size_t nulls;
+        size_t bools;
+        size_t numbers;
+        size_t strings;
+        size_t arrays;
+        size_t maps;
+        size_t max_depth;       // 1 for a scalar
+        size_t string_bytes;    // texts of strings and keys
+        size_t tombstones;      // erased map slots
+        size_t slack;           // bytes of the unused capacity of containers
+
+        MemoryStats()
+            : bytes(0), nulls(0), bools(0), numbers(0), strings(0), arrays(0), maps(0)
+            , max_depth(0), string_bytes(0), tombstones(0), slack(0)
+        {}
+    };
 
     struct _NodeReader {
         bool ok() const {
@@ -42,17 +104,86 @@ namespace j {
         ConstArrayResult get_arr() const;
         bool is_map() const;
         ConstMapResult get_map() const;
+        // the containers are shared until written, O(1), see NodeResult::set()
         _MovingNode clone() const;
+        // walk the tree, O(n)
+        MemoryStats memory_stats() const;
 
-        _NodeReader() : ref(NULL) {}
+        _NodeReader() : ref(NULL), arena(NULL) {}
 
         // private
         _Node *ref;
+        _Arena *arena;
     };
 
     struct ConstNodeResult : _NodeReader {};
 
-    struct NodeResult : _NodeReader {
+    // A writer handle is linked to the arena of the Doc while it refers to a node,
+    // it follows the node moved by the growth of the container, see _relocate(),
+    // and becomes invalid if the node is removed or the Doc is cleared.
+    struct _Link {
+        _Link *prev;
+        _Link *next;
+        _Node **ref;    // of the handle
+    };
+
+    // link to arena if the handle refers to a node
+    inline void _link(_Link *link, _Arena *arena) {
+        if (*link->ref && arena) {
+            _Link *head = (_Link *)arena;   // NOTE: the first member of _Arena
+            link->prev = head;
+            link->next = head->next;
+            head->next->prev = link;
+            head->next = link;
+        }
+    }
+
+    inline void _unlink(_Link *link) {
+        if (link->prev) {
+            link->prev->next = link->next;
+            link->next->prev = link->prev;
+            link->prev = link->next = NULL;
+        }
+    }
+
+    template <class Reader>
+    struct _Writer : Reader {
+        _Writer() {
+            this->link.prev = this->link.next = NULL;
+            this->link.ref = &this->ref;
+        }
+        _Writer(const _Writer &other) : Reader(other) {
+            this->link.prev = this->link.next = NULL;
+            this->link.ref = &this->ref;
+            _link(&this->link, this->arena);
+        }
+        _Writer &operator=(const _Writer &other) {
+            if (this != &other) {
+                _unlink(&this->link);
+                Reader::operator=(other);
+                _link(&this->link, this->arena);
+            }
+            return *this;
+        }
+        ~_Writer() {
+            _unlink(&this->link);
+        }
+
+        // private
+        void bind(_Node *ref, _Arena *arena) {
+            _unlink(&this->link);
+            this->ref = ref;
+            this->arena = arena;
+            _link(&this->link, arena);
+        }
+        _Link link;
+    };
+
+    // NOTE: set() shares the containers of src if it is in another Doc, they are copied
+    // NOTE: level by level when written from either side, the other Doc is kept alive meanwhile.
+    // NOTE: src is copied at once instead if its Doc has writer handles to the nodes under src,
+    // NOTE: the same for clone() and detach().
+    struct NodeResult : _Writer<_NodeReader> {
         // writer
         void set(ConstNodeResult src);
         void set(NodeResult src);
@@ -61,9 +192,20 @@ namespace j {
         void set_u64(uint64_t val);
         void set_i64(int64_t val);
         void set_double(double val);
+        // the shortest text of the float instead of the double
+        void set_float(float val);
         void set_str(const std::string &val);
         ArrayResult set_arr();
         MapResult set_map();
+        // move the tree of src into the node, src becomes empty, O(1)
+        // NOTE: the NodeResults of src are invalidated.
+        void adopt(Doc &src);
+#if __cplusplus >= 201103L
+        void adopt(Doc &&src);
+#endif
+        // move the subtree out to a new Doc, the node becomes null, O(1)
+        // NOTE: the subtree is copied on write, the arena is kept alive by the new Doc meanwhile.
+        _MovingNode detach();
     };
 
     struct _ArrayReader {
@@ -74,20 +216,29 @@ namespace j {
         size_t size() const;
         ConstNodeResult at(size_t i) const;
 
-        _ArrayReader() : ref(NULL) {}
+        _ArrayReader() : ref(NULL), arena(NULL) {}
 
         // private
         _Node *ref;
+        _Arena *arena;
     };
 
     struct ConstArrayResult : _ArrayReader {};
 
-    struct ArrayResult : _ArrayReader {
+    // NOTE: the elements are stored contiguously, the NodeResults of the elements follow them
+    // NOTE: when the array grows, erase() and clear() invalidate the NodeResults of the removed ones,
+    // NOTE: the ConstNodeResults are invalidated by the writes.
+    struct ArrayResult : _Writer<_ArrayReader> {
         // writer
         NodeResult at(size_t i);
         NodeResult push_back();
         void erase(size_t i);
         ArrayResult clear();
+        size_t capacity() const;
+        void reserve(size_t n);
+        // the unused capacity is returned if the array is the last allocation of the arena,
+        // use Doc::shrink() to release the others
+        void shrink_to_fit();
     };
 
     struct _MapReader {
@@ -100,73 +251,85 @@ namespace j {
         ConstNodeResult key(const char *key) const;
         ConstMapIterator iter() const;
 
-        _MapReader() : ref(NULL) {}
+        _MapReader() : ref(NULL), arena(NULL) {}
 
         // private
         _Node *ref;
+        _Arena *arena;
     };
 
     struct ConstMapResult : _MapReader {};
 
-    // NOTE: the erased key is only marked for deletion, do not insert/erase on the same key frequently
-    struct MapResult : _MapReader {
+    // NOTE: the erased key is marked for deletion, the erased slots are reused
+    // NOTE: by compaction when inserting a new key or by compact().
+    // NOTE: the NodeResults of the values are kept valid like ArrayResult, except for the erased keys.
+    struct MapResult : _Writer<_MapReader> {
         // writer
         NodeResult point(const char *pointer);
         NodeResult key(const char *key);
         MapIterator iter();
         bool erase(const char *key);
         MapResult clear();
+        MapResult compact();
     };
 
     // NOTE: the insertion order is preserved
-    // NOTE: the iterator is valid until MapResult::clear()
+    // NOTE: the iterator is valid until inserting a new key, compact() or clear(),
+    // NOTE: erasing keys while iterating is ok.
     struct ConstMapIterator {
         bool next();
         const std::string &key() const;
         ConstNodeResult value() const;
 
-        ConstMapIterator() : ref(NULL), i(~size_t(0)) {}
+        ConstMapIterator() : ref(NULL), arena(NULL), i(~size_t(0)) {}
 
         // private
         _Node *ref;
+        _Arena *arena;
         size_t i;
     };
 
-    struct MapIterator {
+    struct MapIterator : _Writer<ConstMapIterator> {
         bool next();
         const std::string &key() const;
         NodeResult value() const;
-
-        MapIterator() : ref(NULL), i(~size_t(0)) {}
-
-        // private
-        _Node *ref;
-        size_t i;
     };
 
+    // the root node and the arena owning the tree
     struct _MovingNode {
-        explicit _MovingNode(_Node *ref)
-            : ref(ref)
+        _MovingNode(_Node *ref, _Arena *arena)
+            : ref(ref), arena(arena)
         {}
         _MovingNode(const _MovingNode &other)
-            : ref(other.ref)
+            : ref(other.ref), arena(other.arena)
         {
             other.ref = NULL;
+            other.arena = NULL;
         }
         ~_MovingNode() {
-            assert(this->ref == NULL);
+            assert(this->ref == NULL && this->arena == NULL);
         }
 
         // private
         mutable _Node *ref;
+        mutable _Arena *arena;
     private:
         void operator=(const _MovingNode &);
     };
 
     // NOTE: the reader/writer method on Doc is not necessary,
     // NOTE: use the get_root()/set_root() method instead.
+    // NOTE: all nodes and strings are allocated from an arena owned by the Doc,
+    // NOTE: clear() and the destructor release it at once,
+    // NOTE: unless the containers are shared by clone() or NodeResult::set().
+    // NOTE: clone(), detach() and shrink() allocate from the allocator of the source.
+    // NOTE: the readers are not thread-safe, get_number(), get_str() and the key() of
+    // NOTE: the iterators materialize the text in the arena on the first call,
+    // NOTE: get_str() also decodes the escapes of the string on the first call,
+    // NOTE: use a FrozenDoc to read from multiple threads.
     struct Doc : _NodeReader {
-        Doc() {}
+        Doc() : allocator(malloc_allocator()) {}
+        explicit Doc(Allocator *allocator) : allocator(allocator) {}
         /* implicit */
         Doc(const _MovingNode &move);
         ~Doc();
@@ -189,6 +352,9 @@ namespace j {
         void set_double(double val) {
             return set_root().set_double(val);
         }
+        void set_float(float val) {
+            return set_root().set_float(val);
+        }
         void set_str(const std::string &val) {
             return set_root().set_str(val);
         }
@@ -199,42 +365,205 @@ namespace j {
             return set_root().set_map();
         }
         Doc &clear();
+        // preallocate for nodes values and bytes of strings and containers
+        Doc &reserve(size_t nodes, size_t bytes);
+        // copy the tree to a new arena, the garbage, erased slots and shared containers are released,
+        // NOTE: all NodeResults and iterators are invalidated.
+        Doc &shrink();
+        // bytes held by the arena, including the garbage released by shrink(), O(1)
+        size_t memory_usage() const;
         _MovingNode move();
 
+        // private
+        Allocator *allocator;
+
     private:
         Doc(const Doc &);
         Doc &operator=(const Doc &);
     };
 
+#if __cplusplus >= 201103L
+    inline void NodeResult::adopt(Doc &&src) {
+        this->adopt(src);
+    }
+#endif
+
+    // a value of FrozenDoc, the reader of ConstNodeResult
+    // NOTE: strings are returned by value, or without copying by get_str(&len).
+    struct FrozenNodeResult {
+        bool ok() const {
+            return !!this->doc;
+        }
+        // reader
+        bool is_null() const;
+        bool is_bool() const;
+        bool get_bool(bool def) const;
+        bool is_number() const;
+        std::string get_number(const std::string &def) const;
+        bool is_u64() const;
+        uint64_t get_u64(uint64_t def) const;
+        bool is_i64() const;
+        int64_t get_i64(int64_t def) const;
+        bool is_double() const;
+        double get_double(double def) const;
+        bool is_str() const;
+        std::string get_str(const std::string &def) const;
+        // NUL terminated, NULL if not a string
+        const char *get_str(size_t *len) const;
+        bool is_arr() const;
+        FrozenArrayResult get_arr() const;
+        bool is_map() const;
+        FrozenMapResult get_map() const;
+
+        FrozenNodeResult() : doc(NULL), i(0) {}
+
+        // private
+        const FrozenDoc *doc;
+        size_t i;       // index of the tape
+    };
+
+    struct FrozenArrayIterator {
+        bool next();
+        FrozenNodeResult value() const;
+
+        FrozenArrayIterator() : doc(NULL), i(0), cur(0) {}
+
+        // private
+        const FrozenDoc *doc;
+        size_t i;
+        size_t cur;     // index of the value, 0 before next()
+    };
+
+    // NOTE: the values are found by walking the tape, at() is O(i), use iter() instead.
+    struct FrozenArrayResult {
+        bool ok() const {
+            return !!this->doc;
+        }
+        // reader
+        size_t size() const;
+        FrozenNodeResult at(size_t i) const;
+        FrozenArrayIterator iter() const;
+
+        FrozenArrayResult() : doc(NULL), i(0) {}
+
+        // private
+        const FrozenDoc *doc;
+        size_t i;
+    };
+
+    // NOTE: the document order is preserved
+    struct FrozenMapIterator {
+        bool next();
+        std::string key() const;
+        FrozenNodeResult value() const;
+
+        FrozenMapIterator() : doc(NULL), i(0), cur(0) {}
+
+        // private
+        const FrozenDoc *doc;
+        size_t i;
+        size_t cur;     // index of the key, 0 before next()
+    };
+
+    // NOTE: the keys are scanned linearly, the duplicated keys are kept,
+    // NOTE: key() finds the last one like Doc, while size() and iter() include all of them.
+    struct FrozenMapResult {
+        bool ok() const {
+            return !!this->doc;
+        }
+        // reader
+        size_t size() const;
+        FrozenNodeResult point(const char *pointer) const;
+        FrozenNodeResult key(const char *key) const;
+        FrozenMapIterator iter() const;
+
+        FrozenMapResult() : doc(NULL), i(0) {}
+
+        // private
+        const FrozenDoc *doc;
+        size_t i;
+    };
+
+    // A read-only document for parse once and read, built by Parser::parse().
+    // The values are stored in the document order in a tape of 64-bit entries,
+    // and the strings in another buffer, see j_def.h for the layout.
+    // NOTE: the buffers are reused by the next parse, clear() and the destructor release them.
+    struct FrozenDoc {
+        FrozenDoc()
+            : tape(NULL), size(0), cap(0), strs(NULL), strs_size(0), strs_cap(0)
+            , allocator(malloc_allocator())
+        {}
+        explicit FrozenDoc(Allocator *allocator)
+            : tape(NULL), size(0), cap(0), strs(NULL), strs_size(0), strs_cap(0)
+            , allocator(allocator)
+        {}
+        ~FrozenDoc();
+        FrozenNodeResult get_root() const;
+        FrozenDoc &clear();
+        // bytes of the buffers
+        size_t memory_usage() const;
+
+        // private
+        uint64_t *tape;
+        size_t size;
+        size_t cap;
+        char *strs;
+        size_t strs_size;
+        size_t strs_cap;
+        Allocator *allocator;
+
+    private:
+        FrozenDoc(const FrozenDoc &);
+        FrozenDoc &operator=(const FrozenDoc &);
+    };
+
     struct Parser {
         // options
+        // the max depth of nesting, 1M by default, the open containers are kept on the heap
+        // instead of the C stack, a pointer per level
+        // NOTE: the Dumper and the copies walk the trees on the heap as well.
         uint32_t recursion_limit;
         // bool disallow_nan = false;
         bool allow_comment;
         bool allow_extra_comma;
-        // bool validate_string = false;
+        // the strings and the keys without escapes refer to the input instead of being copied, for Doc only
+        // NOTE: the input must outlive the Doc and the Docs sharing its containers, Doc::shrink() copies them.
+        bool borrow_input;
+        // index the tokens 64 bytes at a time with SIMD before building the Doc, for Doc only,
+        // faster for many small values, slower for long strings
+        // NOTE: ignored with allow_comment, the inputs with errors are parsed again for the error
+        bool structural_index;
+        // reject the strings and the keys which are not valid UTF-8, the escapes are not checked
+        bool validate_string;
         // methods
+        // NOTE: the memory of doc is reused if it is not shared by other Docs,
+        // NOTE: use Doc::clear() or Doc::shrink() to release it.
         bool parse(const char *begin, const char *end, Doc &doc);
         bool parse(const char *begin, Doc &doc);
         bool parse(const std::string &input, Doc &doc);
+        bool parse(const char *begin, const char *end, FrozenDoc &doc);
+        bool parse(const char *begin, FrozenDoc &doc);
+        bool parse(const std::string &input, FrozenDoc &doc);
         const char *what() const {
-            return this->err.c_str();
+            return this->err;
         }
         size_t where() const {
             return this->errpos;
         }
 
         Parser()
-            : recursion_limit(100)
+            : recursion_limit(1000000)
             , allow_comment(false)
             , allow_extra_comma(false)
-            , depth(0)
+            , borrow_input(false)
+            , structural_index(false)
+            , validate_string(false)
+            , err("")
             , errpos(0)
         {}
 
         // private
-        uint32_t depth;
-        std::string err;
+        const char *err;    // static
         size_t errpos;
     };
 
@@ -248,6 +577,7 @@ namespace j {
         uint32_t indent;
         // methods
         std::string dump(const Doc &doc) const;
+        std::string dump(const FrozenDoc &doc) const;
 
         Dumper() : spacing(false), indent(0) {}
     };
@@ -0,0 +1,747 @@
+// system
+#include <stdlib.h>
+#include <assert.h>
+// proj
+#include "j.h"
+#include "j_def.h"
+
+
+namespace j {
+
+    // Allocator
+    struct _MallocAllocator : Allocator {
+        virtual void *allocate(size_t size) {
+            return malloc(size);
+        }
+        virtual void *reallocate(void *p, size_t size, size_t nsize) {
+            (void)size;
+            return realloc(p, nsize);
+        }
+        virtual void deallocate(void *p, size_t size) {
+            (void)size;
+            free(p);
+        }
+    };
+
+    Allocator *malloc_allocator() {
+        static _MallocAllocator allocator;
+        return &allocator;
+    }
+
+    void *CountingAllocator::allocate(size_t size) {
+        this->calls++;
+        if (size > this->limit - this->bytes) {
+            return NULL;
+        }
+        void *p = this->base->allocate(size);
+        if (p) {
+            this->count++;
+            this->bytes += size;
+            if (this->bytes > this->peak) {
+                this->peak = this->bytes;
+            }
+        }
+        return p;
+    }
+
+    void *CountingAllocator::reallocate(void *p, size_t size, size_t nsize) {
+        this->calls++;
+        if (nsize > size && nsize - size > this->limit - this->bytes) {
+            return NULL;
+        }
+        void *np = this->base->reallocate(p, size, nsize);
+        if (np) {
+            this->bytes = this->bytes - size + nsize;
+            if (this->bytes > this->peak) {
+                this->peak = this->bytes;
+            }
+        }
+        return np;
+    }
+
+    void CountingAllocator::deallocate(void *p, size_t size) {
+        this->count--;
+        this->bytes -= size;
+        this->base->deallocate(p, size);
+    }
+
+    // _Arena
+    _Arena::~_Arena() {
+        _unlink_all(*this);
+        this->release_objects();
+        this->release_chunks();
+    }
+
+    void _Arena::release_objects() {
+        // NOTE: the list is allocated from the chunks
+        for (_Dep *dep = this->deps; dep; dep = dep->next) {
+            _arena_release(dep->arena);
+        }
+        this->deps = NULL;
+        for (_Box *box = this->boxes; box; ) {
+            _Box *next = box->next;
+            box->~_Box();
+            box = next;
+        }
+        this->boxes = NULL;
+    }
+
+    void _Arena::release_chunks() {
+        for (_Chunk *chunk = this->chunks; chunk; ) {
+            _Chunk *next = chunk->next;
+            this->allocator->deallocate(chunk, sizeof(_Chunk) + chunk->size);
+            chunk = next;
+        }
+        this->chunks = this->large = NULL;
+        this->cur = this->end = NULL;
+        this->bytes = 0;
+    }
+
+    // a new current chunk
+    void _Arena::add_chunk(size_t csize) {
+        _Chunk *chunk = (_Chunk *)this->allocator->allocate(sizeof(_Chunk) + csize);
+        if (!chunk) {
+            _bad_alloc();
+        }
+        chunk->size = csize;
+        this->bytes += sizeof(_Chunk) + csize;
+        chunk->next = this->chunks;
+        this->chunks = chunk;
+        this->cur = (char *)chunk + sizeof(_Chunk);
+        this->end = this->cur + csize;
+    }
+
+    void _Arena::reserve(size_t size) {
+        size = (size + 7) & ~size_t(7);
+        if ((size_t)(this->end - this->cur) < size) {
+            this->add_chunk(size > this->next_size ? size : this->next_size);
+        }
+    }
+
+    void _Arena::reset() {
+        assert(this->refs == 1 && !this->parent);
+        _unlink_all(*this);
+        this->release_objects();
+        this->shapes = NULL;
+        size_t total = 0;
+        for (_Chunk *chunk = this->chunks; chunk; chunk = chunk->next) {
+            total += chunk->size;
+        }
+        if (this->chunks && !this->chunks->next) {
+            // reuse the only chunk
+            this->large = NULL;
+            this->bytes = sizeof(_Chunk) + this->chunks->size;
+            this->cur = (char *)this->chunks + sizeof(_Chunk);
+            this->end = this->cur + this->chunks->size;
+        } else {
+            this->release_chunks();
+            if (total > 0) {
+                this->add_chunk(total);
+            }
+        }
+    }
+
+    void *_Arena::alloc_slow(size_t size) {
+        // large allocation gets its own chunk, keep the current one
+        if (size > this->next_size / 4) {
+            _Chunk *chunk = (_Chunk *)this->allocator->allocate(sizeof(_Chunk) + size);
+            if (!chunk) {
+                _bad_alloc();
+            }
+            chunk->size = size;
+            this->bytes += sizeof(_Chunk) + size;
+            this->large = chunk;
+            if (this->chunks) {
+                chunk->next = this->chunks->next;
+                this->chunks->next = chunk;
+            } else {
+                chunk->next = NULL;
+                this->chunks = chunk;
+            }
+            return (char *)chunk + sizeof(_Chunk);
+        }
+
+        this->add_chunk(this->next_size);
+        if (this->next_size < k_max_chunk) {
+            this->next_size *= 2;
+        }
+
+        void *p = this->cur;
+        this->cur += size;
+        return p;
+    }
+
+    void *_Arena::resize_large(void *p, size_t size, size_t nsize) {
+        _Chunk *chunk = this->large;
+        assert(p == (char *)chunk + sizeof(_Chunk));
+        (void)p;
+        if (size != chunk->size || nsize <= this->next_size / 4) {
+            return NULL;
+        }
+        _Chunk *prev = NULL;
+        for (_Chunk *i = this->chunks; i != chunk; i = i->next) {
+            prev = i;
+        }
+        _Chunk *nchunk = (_Chunk *)this->allocator->reallocate(
+            chunk, sizeof(_Chunk) + size, sizeof(_Chunk) + nsize);
+        if (!nchunk) {
+            return NULL;
+        }
+        this->bytes += nsize - size;
+        nchunk->size = nsize;
+        if (prev) {
+            prev->next = nchunk;
+        } else {
+            this->chunks = nchunk;
+        }
+        this->large = nchunk;
+        return (char *)nchunk + sizeof(_Chunk);
+    }
+
+    const std::string &_Arena::box(_Node *node) {
+        assert(node->type == T_NUM || node->type == T_STR);
+        if (!(node->flags & F_BOXED)) {
+            _decode_text(*this, node);
+            _Box *box = new (this->alloc(sizeof(_Box))) _Box();
+            if (node->type == T_NUM) {
+                char buf[24];
+                size_t len = 0;
+                const char *text = _num_text(node, buf, &len);
+                box->str.assign(text, len);
+            } else {
+                box->str.assign(node->str, node->len);
+            }
+            box->orig = *node;
+            this->bytes += _heap_bytes(box->str);
+            box->next = this->boxes;
+            this->boxes = box;
+            node->box = box;
+            node->flags |= F_BOXED;
+        }
+        return node->box->str;
+    }
+
+    // nodes
+    void _init(_Arena &arena, _Node *node, uint8_t type) {
+        _node_init(node, type);
+        if (type == T_ARR) {
+            _Array *arr = (_Array *)arena.alloc(sizeof(_Array));
+            arr->size = arr->cap = 0;
+            arr->values = NULL;
+            arr->arena = &arena;
+            arr->refs = 1;
+            node->arr = arr;
+        } else if (type == T_MAP) {
+            _Map *map = (_Map *)arena.alloc(sizeof(_Map));
+            map->cap = 0;
+            map->values = NULL;
+            map->arena = &arena;
+            map->refs = 1;
+            _map_clear(arena, map);
+            node->map = map;
+        } else if (type == T_NUM) {
+            node->flags = F_INT;
+        } else if (type == T_STR) {
+            node->str = "";
+        }
+    }
+
+    void _set_text(_Arena &arena, _Node *node, uint8_t type, const char *data, size_t len) {
+        assert(type == T_STR);
+        assert(len <= 0xffffffffu);
+        _node_init(node, type);
+        node->len = (uint32_t)len;
+        node->str = arena.copy_str(data, len);
+    }
+
+    void _borrow_text(_Node *node, uint8_t type, const char *data, size_t len) {
+        assert(type == T_STR);
+        assert(len <= 0xffffffffu);
+        _node_init(node, type);
+        node->flags = F_BORROWED;
+        node->len = (uint32_t)len;
+        node->str = data;
+    }
+
+    void _decode_text(_Arena &arena, _Node *node) {
+        if (node->flags & F_ESCAPED) {
+            // NOTE: not in place, the raw text may be shared by the nodes copied by _writable_arr()
+            char *text = (char *)arena.alloc(node->len + 1);
+            size_t len = _unescape(node->str, node->len, text);
+            text[len] = '\0';
+            node->flags &= ~(F_ESCAPED | F_BORROWED);
+            node->len = (uint32_t)len;
+            node->str = text;
+        }
+    }
+
+    // handles
+    void _relocate(_Arena &arena, const _Node *values, uint32_t size, _Node *nvalues) {
+        uintptr_t begin = (uintptr_t)values;
+        uintptr_t end = (uintptr_t)(values + size);
+        for (_Link *link = arena.handles.next; link != &arena.handles; ) {
+            _Link *next = link->next;
+            uintptr_t ref = (uintptr_t)*link->ref;
+            if (begin <= ref && ref < end) {
+                if (nvalues) {
+                    *link->ref = nvalues + (ref - begin) / sizeof(_Node);
+                } else {
+                    *link->ref = NULL;
+                    _unlink(link);
+                }
+            }
+            link = next;
+        }
+    }
+
+    void _unlink_all(_Arena &arena) {
+        while (arena.handles.next != &arena.handles) {
+            _Link *link = arena.handles.next;
+            *link->ref = NULL;
+            _unlink(link);
+        }
+    }
+
+    // in place if values is the last allocation
+    static _Node *_realloc(_Arena &arena, _Node *values, uint32_t size, uint32_t cap, uint32_t ncap) {
+        _Node *nvalues = (_Node *)arena.resize(values, sizeof(_Node) * cap, sizeof(_Node) * ncap);
+        if (!nvalues) {
+            nvalues = (_Node *)arena.alloc(sizeof(_Node) * ncap);
+            if (size > 0) {
+                memcpy((void *)nvalues, (const void *)values, sizeof(_Node) * size);
+            }
+        }
+        if (nvalues != values && size > 0) {
+            _relocate(arena, values, size, nvalues);
+        }
+        return nvalues;
+    }
+
+    _Node *_grow(_Arena &arena, _Node *values, uint32_t size, uint32_t *cap) {
+        uint32_t ncap = *cap < 4 ? 4 : *cap * 2;
+        _Node *nvalues = _realloc(arena, values, size, *cap, ncap);
+        *cap = ncap;
+        return nvalues;
+    }
+
+    _Node *_arr_push(_Arena &arena, _Array *arr) {
+        if (arr->size == arr->cap) {
+            arr->values = _grow(arena, arr->values, arr->size, &arr->cap);
+        }
+        _Node *node = &arr->values[arr->size++];
+        _node_init(node, T_DEL);
+        return node;
+    }
+
+    void _arr_reserve(_Arena &arena, _Array *arr, size_t n) {
+        if (n <= arr->cap) {
+            return;
+        }
+        if (n > 0xffffffffu) {
+            _bad_alloc();
+        }
+        arr->values = _realloc(arena, arr->values, arr->size, arr->cap, (uint32_t)n);
+        arr->cap = (uint32_t)n;
+    }
+
+    void _arr_shrink(_Arena &arena, _Array *arr) {
+        if (arr->cap > arr->size) {
+            if (void *p = arena.resize(arr->values, sizeof(_Node) * arr->cap, sizeof(_Node) * arr->size)) {
+                if (p != arr->values) {
+                    _relocate(arena, arr->values, arr->size, (_Node *)p);
+                }
+                arr->values = (_Node *)p;
+                arr->cap = arr->size;
+            }
+        }
+    }
+
+    void _arr_erase(_Arena &arena, _Array *arr, uint32_t i) {
+        _Node *values = arr->values;
+        _drop(arena, &values[i]);
+        _relocate(arena, &values[i], 1, NULL);
+        memmove((void *)&values[i], (const void *)&values[i + 1], sizeof(_Node) * (arr->size - i - 1));
+        _relocate(arena, &values[i + 1], arr->size - i - 1, &values[i]);
+        arr->size--;
+    }
+
+    // the open containers of _copy()
+    struct _CopyFrame {
+        _Node *dst;
+        const _Node *src;
+        uint32_t i;         // the next child of src
+    };
+
+    // a scalar, or an empty container of the type
+    static void _copy_node(_Arena &arena, _Node *dst, const _Node *src) {
+        if (src->type == T_NUM) {
+            const _Node *num = _unbox(src);
+            if (num->flags & F_INT) {
+                *dst = *num;
+            } else {
+                _set_num(arena, dst, num->str, num->len, _num_double(num));
+            }
+        } else if (src->type == T_STR) {
+            _set_text(arena, dst, src->type, _text(src), src->len);
+            // still raw
+            dst->flags |= src->flags & F_ESCAPED;
+        } else if (src->type == T_ARR) {
+            _init(arena, dst, T_ARR);
+            _arr_reserve(arena, dst->arr, src->arr->size);
+        } else if (src->type == T_MAP) {
+            _init(arena, dst, T_MAP);
+        } else {
+            _node_init(dst, src->type);
+        }
+    }
+
+    // copy the children of frame until a container, which is to be copied next
+    static bool _copy_children(_Arena &arena, _CopyFrame &frame, _CopyFrame *next) {
+        uint32_t i = frame.i;
+        const _Node *child = NULL;
+        _Node *copy = NULL;
+        if (frame.src->type == T_ARR) {
+            const _Array *sarr = frame.src->arr;
+            _Array *darr = frame.dst->arr;
+            while (i < sarr->size) {
+                child = &sarr->values[i++];
+                copy = _arr_push(arena, darr);
+                _copy_node(arena, copy, child);
+                if (child->type == T_ARR || child->type == T_MAP) {
+                    break;
+                }
+                child = NULL;
+            }
+        } else {
+            const _Map *smap = frame.src->map;
+            _Map *dmap = frame.dst->map;
+            while (i < smap->size) {
+                const _Node *name = &smap->names[i];
+                child = &smap->values[i++];
+                if (child->type != T_DEL) {
+                    copy = _map_push(arena, dmap, _text(name), name->len);
+                    _copy_node(arena, copy, child);
+                    if (child->type == T_ARR || child->type == T_MAP) {
+                        break;
+                    }
+                }
+                child = NULL;
+            }
+        }
+        frame.i = i;
+        if (!child) {
+            return false;
+        }
+        next->dst = copy;
+        next->src = child;
+        next->i = 0;
+        return true;
+    }
+
+    // NOTE: not recursive, a copied node does not move while its children are copied.
+    static void _copy_deep(_Arena &arena, _Node *dst, const _Node *src) {
+        _copy_node(arena, dst, src);
+        if (src->type != T_ARR && src->type != T_MAP) {
+            return;
+        }
+        _Stack<_CopyFrame> stack(arena.allocator);
+        _CopyFrame frame = { dst, src, 0 };
+        stack.push(frame);
+        while (stack.size > 0) {
+            if (_copy_children(arena, stack.items[stack.size - 1], &frame)) {
+                stack.push(frame);
+            } else {
+                stack.pop();
+            }
+        }
+    }
+
+    // recursive for the first levels, faster than _copy_deep()
+    static void _copy_at(_Arena &arena, _Node *dst, const _Node *src, uint32_t depth) {
+        if (depth >= k_recursion_depth) {
+            _copy_deep(arena, dst, src);
+            return;
+        }
+        _copy_node(arena, dst, src);
+        if (src->type == T_ARR) {
+            const _Array *sarr = src->arr;
+            for (uint32_t i = 0; i < sarr->size; ++i) {
+                _copy_at(arena, _arr_push(arena, dst->arr), &sarr->values[i], depth + 1);
+            }
+        } else if (src->type == T_MAP) {
+            const _Map *smap = src->map;
+            for (uint32_t i = 0; i < smap->size; ++i) {
+                if (smap->values[i].type == T_DEL) {
+                    continue;
+                }
+                const _Node *name = &smap->names[i];
+                _copy_at(arena, _map_push(arena, dst->map, _text(name), name->len), &smap->values[i], depth + 1);
+            }
+        }
+    }
+
+    // deep copy, src may be in another arena
+    void _copy(_Arena &arena, _Node *dst, const _Node *src) {
+        _copy_at(arena, dst, src, 0);
+    }
+
+    void _bad_alloc() {
+#if defined(__cpp_exceptions) || defined(__EXCEPTIONS)
+        throw std::bad_alloc();
+#else
+        abort();
+#endif
+    }
+
+    _Arena *_arena_new(Allocator *allocator) {
+        void *p = allocator->allocate(sizeof(_Arena));
+        if (!p) {
+            _bad_alloc();
+        }
+        return new (p) _Arena(allocator);
+    }
+
+    void _arena_release(_Arena *arena) {
+        if (--arena->refs == 0) {
+            Allocator *allocator = arena->allocator;
+            arena->~_Arena();
+            allocator->deallocate(arena, sizeof(_Arena));
+        }
+    }
+
+    static bool _reachable(const _Arena *from, const _Arena *to) {
+        if (from == to) {
+            return true;
+        }
+        for (const _Arena::_Dep *dep = from->deps; dep; dep = dep->next) {
+            if (_reachable(dep->arena, to)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool _arena_depend(_Arena &arena, _Arena *dep) {
+        if (dep == &arena) {
+            return true;
+        }
+        for (const _Arena::_Dep *i = arena.deps; i; i = i->next) {
+            if (i->arena == dep) {
+                return true;
+            }
+        }
+        if (_reachable(dep, &arena)) {
+            return false;
+        }
+        _Arena::_Dep *d = (_Arena::_Dep *)arena.alloc(sizeof(_Arena::_Dep));
+        d->arena = dep;
+        d->next = arena.deps;
+        arena.deps = d;
+        dep->refs++;
+        return true;
+    }
+
+    bool _arena_merge(_Arena &arena, _Arena *src) {
+        if (src == &arena || src->refs != 1 || src->allocator != arena.allocator || _reachable(src, &arena)) {
+            return false;
+        }
+        // splice the lists, keep the current chunk of arena at the head
+        if (_Arena::_Chunk *chunk = src->chunks) {
+            while (chunk->next) {
+                chunk = chunk->next;
+            }
+            if (arena.chunks) {
+                chunk->next = arena.chunks->next;
+                arena.chunks->next = src->chunks;
+            } else {
+                arena.chunks = src->chunks;
+            }
+        }
+        if (_Box *box = src->boxes) {
+            while (box->next) {
+                box = box->next;
+            }
+            box->next = arena.boxes;
+            arena.boxes = src->boxes;
+        }
+        if (_Arena::_Dep *dep = src->deps) {
+            while (dep->next) {
+                dep = dep->next;
+            }
+            dep->next = arena.deps;
+            arena.deps = src->deps;
+        }
+        arena.bytes += src->bytes;
+        src->chunks = src->large = NULL;
+        src->cur = src->end = NULL;
+        src->boxes = NULL;
+        src->deps = NULL;
+        src->bytes = 0;
+
+        // the containers still point to src, which is kept as an alias
+        src->parent = &arena;
+        _Arena::_Dep *d = (_Arena::_Dep *)arena.alloc(sizeof(_Arena::_Dep));
+        d->arena = src;
+        d->next = arena.deps;
+        arena.deps = d;
+        return true;
+    }
+
+    static inline void _ref(_Node *node) {
+        if (node->type == T_ARR) {
+            node->arr->refs++;
+        } else if (node->type == T_MAP) {
+            node->map->refs++;
+        }
+    }
+
+    // drop a reference to the container of node, true if it is no longer referenced
+    static inline bool _unref(const _Node *node) {
+        if (node->type == T_ARR) {
+            return --node->arr->refs == 0;
+        } else if (node->type == T_MAP) {
+            return --node->map->refs == 0;
+        }
+        return false;
+    }
+
+    static inline uint32_t _children(const _Node *node, const _Node **values) {
+        if (node->type == T_ARR) {
+            *values = node->arr->values;
+            return node->arr->size;
+        } else {
+            *values = node->map->values;
+            return node->map->size;
+        }
+    }
+
+    // a writer handle of arena refers to a node in the tree of node, node itself excluded
+    static bool _handles_in(_Arena &arena, const _Node *node) {
+        if (arena.handles.next == &arena.handles) {
+            return false;
+        }
+        // NOTE: the handles are only taken in the containers written in place,
+        // NOTE: the shared and the foreign ones are skipped with their subtrees.
+        _Stack<const _Node *> stack(arena.allocator);
+        stack.push(node);
+        while (stack.size > 0) {
+            const _Node *cur = stack.top();
+            stack.pop();
+            if (cur->type == T_ARR) {
+                if (cur->arr->refs != 1 || cur->arr->arena->owner() != &arena) {
+                    continue;
+                }
+            } else if (cur->type == T_MAP) {
+                if (cur->map->refs != 1 || cur->map->arena->owner() != &arena) {
+                    continue;
+                }
+            } else {
+                continue;
+            }
+            const _Node *values = NULL;
+            uint32_t size = _children(cur, &values);
+            for (const _Link *link = arena.handles.next; link != &arena.handles; link = link->next) {
+                if (values <= *link->ref && *link->ref < values + size) {
+                    return true;
+                }
+            }
+            for (uint32_t i = 0; i < size; ++i) {
+                stack.push(&values[i]);
+            }
+        }
+        return false;
+    }
+
+    void _share(_Arena &arena, _Node *dst, const _Node *src, _Arena *src_arena) {
+        // NOTE: the containers of arena are copied, src may be an ancestor of dst,
+        // NOTE: while the ancestors of a writer are always owned by its arena.
+        // NOTE: the handles taken before sharing would write to the containers without _writable_arr(),
+        // NOTE: so src is copied if there are any in its tree.
+        const _Arena *owner = &arena;
+        if (src->type == T_ARR) {
+            owner = src->arr->arena->owner();
+        } else if (src->type == T_MAP) {
+            owner = src->map->arena->owner();
+        }
+        if (owner == &arena || _handles_in(*src_arena, src) || !_arena_depend(arena, src_arena)) {
+            _Node tmp;
+            _copy(arena, &tmp, src);
+            *dst = tmp;
+            return;
+        }
+        *dst = *src;
+        _ref(dst);
+    }
+
+    void _drop(_Arena &arena, const _Node *node) {
+        if (!_unref(node)) {
+            return;
+        }
+        // NOTE: not recursive, the trees may be deep
+        _Stack<const _Node *> dead(arena.allocator);
+        dead.push(node);
+        while (dead.size > 0) {
+            const _Node *cur = dead.top();
+            dead.pop();
+            const _Node *values = NULL;
+            uint32_t size = _children(cur, &values);
+            // NOTE: the handles left in a dead container would write to the children shared by others
+            _relocate(arena, values, size, NULL);
+            for (uint32_t i = 0; i < size; ++i) {
+                if (_unref(&values[i])) {
+                    dead.push(&values[i]);
+                }
+            }
+        }
+    }
+
+    void _discard(_Arena &arena, const _Node *root) {
+        // NOTE: only the containers of the other arenas outlive it, there are none without deps
+        if (root && arena.deps) {
+            _drop(arena, root);
+        }
+    }
+
+    _Array *_writable_arr(_Arena &arena, _Node *node) {
+        _Array *arr = node->arr;
+        if (arr->refs == 1 && arr->arena->owner() == &arena) {
+            return arr;
+        }
+        const _Node old = *node;
+        // copy one level, the children are shared
+        _init(arena, node, T_ARR);
+        _Array *copy = node->arr;
+        _arr_reserve(arena, copy, arr->size);
+        if (arr->size > 0) {
+            memcpy((void *)copy->values, (const void *)arr->values, sizeof(_Node) * arr->size);
+        }
+        copy->size = arr->size;
+        for (uint32_t i = 0; i < copy->size; ++i) {
+            _ref(&copy->values[i]);
+        }
+        _drop(arena, &old);
+        return copy;
+    }
+
+    _Map *_writable_map(_Arena &arena, _Node *node) {
+        _Map *map = node->map;
+        if (map->refs == 1 && map->arena->owner() == &arena) {
+            return map;
+        }
+        const _Node old = *node;
+        _init(arena, node, T_MAP);
+        _Map *copy = node->map;
+        for (uint32_t i = 0; i < map->size; ++i) {
+            const _Node *name = &map->names[i];
+            if (name->type == T_DEL) {
+                continue;
+            }
+            _Node *value = _map_push(arena, copy, _text(name), name->len);
+            *value = map->values[i];
+            _ref(value);
+        }
+        _drop(arena, &old);
+        return copy;
+    }
+
+}   // ::j
@@ -1,9 +1,13 @@
 #pragma once
 
 // system
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <new>
 #include <string>
-#include <deque>
-#include <map>
+// proj
+#include "j.h"
 
 
 namespace j {
@@ -19,14 +23,429 @@ namespace j {
         T_MAP = 7,
     };
 
+    // _Node::flags
+    enum {
+        F_BOXED = 1,    // T_NUM, T_STR: the text was materialized as _Node::box->str
+        F_INT = 2,      // T_NUM: an integer without text, _Node::u64, or _Node::i64 with F_NEG
+        F_NEG = 4,
+        F_BORROWED = 8, // T_STR: the text is in the input of the parser, see Parser::borrow_input
+        F_ESCAPED = 16, // T_STR: the raw text with escapes from the parser, decoded on the first access
+    };
+
+    struct Allocator;
+    struct _Arena;
+    struct _Array;
+    struct _Map;
+    struct _Shape;
+    struct _Box;
+
+    // A value is a type tag plus an inline payload (16 bytes),
+    // strings and containers are stored out-of-line in the _Arena of the Doc.
+    // NOTE: nodes are PODs, they are released with the arena.
     struct _Node {
-        uint32_t type;
-        std::string val;
-        std::deque<_Node> values;
-        std::map<std::string, size_t> keys;
-        std::string key;
+        uint8_t type;
+        uint8_t flags;
+        uint16_t reserved;
+        uint32_t len;           // T_NUM, T_STR: bytes of the text
+        union {
+            void *ptr;
+            const char *str;    // T_NUM, T_STR: NUL terminated text, unless F_BORROWED
+            uint64_t u64;       // T_NUM with F_INT
+            int64_t i64;        // T_NUM with F_INT | F_NEG
+            _Box *box;          // T_NUM, T_STR with F_BOXED
+            _Array *arr;        // T_ARR
+            _Map *map;          // T_MAP
+        };
+    };
+
+    inline void _node_init(_Node *node, uint8_t type) {
+        node->type = type;
+        node->flags = 0;
+        node->reserved = 0;
+        node->len = 0;
+        node->ptr = NULL;
+    }
+
+    // the text as std::string, for the APIs returning a reference
+    struct _Box {
+        std::string str;
+        _Box *next;
+        _Node orig;     // the node before boxing
+    };
+
+    inline const char *_text(const _Node *node) {
+        return (node->flags & F_BOXED) ? node->box->str.c_str() : node->str;
+    }
+
+    // bytes allocated by the string
+    inline size_t _heap_bytes(const std::string &str) {
+        const char *data = str.data();
+        if (data >= (const char *)&str && data < (const char *)(&str + 1)) {
+            return 0;   // short string
+        }
+        return str.capacity() + 1;
+    }
+
+    inline const _Node *_unbox(const _Node *node) {
+        return (node->flags & F_BOXED) ? &node->box->orig : node;
+    }
 
-        _Node() : type(0) {}
+    // A T_NUM without F_INT is the text preceded by its double value.
+    // the nearest double of [+-]digits[.digits][(e|E)[+-]digits], NaN or Infinity,
+    // returns the end of the text consumed, or begin if none
+    // NOTE: like strtod() in the C locale without the leading spaces and the hex floats
+    const char *_strtod(const char *begin, const char *end, double *out);
+
+    inline double _num_double(const _Node *node) {
+        double d;
+        memcpy(&d, _unbox(node)->str - sizeof(double), sizeof(double));
+        return d;
+    }
+
+    // Bump allocator, everything of a Doc is allocated from it and
+    // released at once by the destructor.
+    // NOTE: a tree may share the containers of other arenas, which are kept alive by
+    // NOTE: the reference counting, see _arena_release() and _arena_depend().
+    struct _Arena {
+        struct _Chunk {
+            _Chunk *next;
+            size_t size;
+        };
+        struct _Dep {
+            _Arena *arena;
+            _Dep *next;
+        };
+
+        _Link handles;  // the writer handles, a circular list, the first member for _link()
+        _Chunk *chunks;
+        char *cur;
+        char *end;
+        size_t next_size;
+        _Chunk *large;  // the last chunk of a large allocation
+        _Box *boxes;    // need destructor
+        _Shape *shapes; // the root shape
+        size_t bytes;   // chunks and the heap memory of boxes
+        uint32_t refs;  // the owning Doc and the dependent arenas
+        _Dep *deps;     // the arenas shared from
+        _Arena *parent; // merged into, see _arena_merge()
+        Allocator *allocator;   // of the chunks and the arena itself
+
+        explicit _Arena(Allocator *allocator)
+            : chunks(NULL), cur(NULL), end(NULL), next_size(k_min_chunk)
+            , large(NULL), boxes(NULL), shapes(NULL), bytes(0), refs(1), deps(NULL), parent(NULL)
+            , allocator(allocator)
+        {
+            this->handles.prev = this->handles.next = &this->handles;
+            this->handles.ref = NULL;
+        }
+        ~_Arena();
+
+        static const size_t k_min_chunk = 4096;
+        static const size_t k_max_chunk = 1024 * 1024;
+
+        // 8 bytes aligned
+        void *alloc(size_t size) {
+            size = (size + 7) & ~size_t(7);
+            if ((size_t)(this->end - this->cur) < size) {
+                return this->alloc_slow(size);
+            }
+            void *p = this->cur;
+            this->cur += size;
+            return p;
+        }
+        void *alloc_slow(size_t size);
+        // make room for size bytes in the current chunk
+        void reserve(size_t size);
+        // release everything but keep the memory in one chunk for reuse, the handles are invalidated
+        void reset();
+
+        _Node *new_node(uint8_t type = T_DEL) {
+            _Node *node = (_Node *)this->alloc(sizeof(_Node));
+            _node_init(node, type);
+            return node;
+        }
+        // NUL terminated copy
+        const char *copy_str(const char *data, size_t size) {
+            char *p = (char *)this->alloc(size + 1);
+            memcpy(p, data, size);
+            p[size] = '\0';
+            return p;
+        }
+        const std::string &box(_Node *node);
+        // resize the last allocation in place, or the last large allocation by reallocate(),
+        // NULL if not possible
+        void *resize(void *p, size_t size, size_t nsize) {
+            size = (size + 7) & ~size_t(7);
+            nsize = (nsize + 7) & ~size_t(7);
+            if ((char *)p + size == this->cur && nsize <= size + (size_t)(this->end - this->cur)) {
+                this->cur = (char *)p + nsize;
+                return p;
+            }
+            if (this->large && p == (char *)this->large + sizeof(_Chunk)) {
+                return this->resize_large(p, size, nsize);
+            }
+            return NULL;
+        }
+        void *resize_large(void *p, size_t size, size_t nsize);
+        // the arena holding the memory now
+        _Arena *owner() {
+            _Arena *arena = this;
+            while (arena->parent) {
+                arena = arena->parent;
+            }
+            return arena;
+        }
+
+    private:
+        void add_chunk(size_t csize);
+        void release_objects();
+        void release_chunks();
+        _Arena(const _Arena &);
+        _Arena &operator=(const _Arena &);
     };
 
+    // NOTE: the elements are contiguous, growing may move them
+    // NOTE: containers are copied on write if they are shared (refs > 1) or owned by another arena
+    struct _Array {
+        uint32_t size;
+        uint32_t cap;
+        _Node *values;
+        _Arena *arena;      // the owner
+        uint32_t refs;      // number of nodes referencing it
+    };
+
+    // an entry of the hash index, slot is the index of names/values plus 1, 0 for empty
+    struct _HashEntry {
+        uint32_t hash;
+        uint32_t slot;
+    };
+
+    // names shared by a chain of shapes, used is the number of names taken
+    struct _NameBuf {
+        uint32_t used;
+        uint32_t cap;
+        _Node *names;
+    };
+
+    // a child shape by the hash of its last key
+    struct _Transition {
+        uint32_t hash;
+        _Shape *shape;          // NULL for empty
+    };
+
+    // An immutable key sequence shared by the maps with the same keys in the same order.
+    // Shapes form a tree by the key appended (transitions), the root is the empty shape.
+    // A shape is only extended after another map took it, so the maps with distinct keys
+    // become dictionaries instead of growing the tree.
+    // NOTE: there are no duplicated or erased keys in a shape.
+    struct _Shape {
+        uint32_t count;         // number of keys
+        uint32_t mask;          // hash table size - 1, 0 if not built
+        _Node *names;
+        _NameBuf *buf;
+        _HashEntry *table;      // built when the shape is reused if there are many keys
+        _Shape *children;       // transitions
+        _Shape *sibling;
+        _Transition *child_table;   // the index of the children if there are many
+        uint32_t child_mask;
+        uint32_t nchildren;
+        uint32_t uses;          // number of maps that took it, up to 2
+    };
+
+    // The key index of a map is pluggable by size: small maps are scanned linearly,
+    // large maps use an open-addressing hash table with the key hashes cached.
+    // A map with a shape shares the keys and the key index of the shape and stores
+    // only the values, it becomes a dictionary with its own keys when a key is erased,
+    // a duplicated key is inserted, a key is added to a shape no other map took,
+    // or the number of keys exceeds k_max_shape_keys.
+    // NOTE: names[i] is the key (a T_STR node) of values[i],
+    // NOTE: erased entries are marked T_DEL in both names and values.
+    struct _Map {
+        uint32_t size;      // used slots, including the erased ones
+        uint32_t cap;
+        uint32_t count;     // number of keys
+        uint32_t mask;      // hash table size - 1, 0 for linear scan
+        _Node *names;       // owned, or shape->names
+        _Node *values;
+        _HashEntry *table;
+        _Shape *shape;      // NULL for dictionary
+        _Arena *arena;      // the owner
+        uint32_t refs;      // number of nodes referencing it
+    };
+
+    // use the hash table when there are more slots to scan
+    static const uint32_t k_linear_keys = 8;
+    // maps with more keys do not use shapes
+    static const uint32_t k_max_shape_keys = 64;
+    // compact instead of growing if 1/k_compact_ratio of the slots are erased
+    static const uint32_t k_compact_ratio = 4;
+    // the walks of the trees recurse on the C stack up to the depth, the deeper subtrees
+    // are walked with a _Stack on the heap
+    static const uint32_t k_recursion_depth = 64;
+
+    // An entry of the tape of FrozenDoc is the type and the flags of _Node in the high 16 bits,
+    // and a 48-bit payload:
+    //   T_NULL, T_TRUE, T_FALSE: unused
+    //   T_NUM with F_INT: unused, the next entry is _Node::u64
+    //   T_NUM: offset of the text, the next entry is the double converted
+    //   T_STR: offset of the string buffer, where the text follows its length (uint32_t)
+    //   T_ARR, T_MAP: index after the last value, the next entry is the number of values
+    // NOTE: the values of a map are preceded by the keys (T_STR),
+    // NOTE: the duplicated keys are kept.
+    static const uint64_t k_tape_payload = (uint64_t(1) << 48) - 1;
+
+    inline uint64_t _tape_entry(uint8_t type, uint8_t flags, uint64_t payload) {
+        return (uint64_t(type) << 56) | (uint64_t(flags) << 48) | payload;
+    }
+    inline uint8_t _tape_type(uint64_t e) {
+        return uint8_t(e >> 56);
+    }
+    inline uint8_t _tape_flags(uint64_t e) {
+        return uint8_t(e >> 48);
+    }
+    inline uint64_t _tape_payload(uint64_t e) {
+        return e & k_tape_payload;
+    }
+    // the index of the next value
+    inline size_t _tape_next(const uint64_t *tape, size_t i) {
+        uint64_t e = tape[i];
+        uint8_t type = _tape_type(e);
+        if (type == T_ARR || type == T_MAP) {
+            return (size_t)_tape_payload(e);
+        }
+        return type == T_NUM ? i + 2 : i + 1;
+    }
+    inline const char *_tape_text(const char *strs, uint64_t e, uint32_t *len) {
+        const char *p = strs + _tape_payload(e);
+        memcpy(len, p, sizeof(uint32_t));
+        return p + sizeof(uint32_t);
+    }
+
+    // from j_arena.cpp
+    // reset node to an empty value of the type
+    void _init(_Arena &arena, _Node *node, uint8_t type);
+    void _set_text(_Arena &arena, _Node *node, uint8_t type, const char *data, size_t len);
+    // refer to the text without copying, it must outlive the arena
+    void _borrow_text(_Node *node, uint8_t type, const char *data, size_t len);
+    // decode the text of F_ESCAPED and cache it in the node
+    void _decode_text(_Arena &arena, _Node *node);
+    // the handles referring to values[0, size) follow the nodes moved to nvalues,
+    // or are invalidated if nvalues is NULL
+    void _relocate(_Arena &arena, const _Node *values, uint32_t size, _Node *nvalues);
+    // invalidate all handles of the arena
+    void _unlink_all(_Arena &arena);
+    // grow values to hold more than size nodes
+    _Node *_grow(_Arena &arena, _Node *values, uint32_t size, uint32_t *cap);
+    _Node *_arr_push(_Arena &arena, _Array *arr);
+    void _arr_reserve(_Arena &arena, _Array *arr, size_t n);
+    void _arr_shrink(_Arena &arena, _Array *arr);
+    void _arr_erase(_Arena &arena, _Array *arr, uint32_t i);
+    void _copy(_Arena &arena, _Node *dst, const _Node *src);
+    // throw std::bad_alloc, or abort() when built with -fno-exceptions
+    __attribute__((noreturn)) void _bad_alloc();
+    // a new arena allocated by allocator
+    _Arena *_arena_new(Allocator *allocator);
+    // drop a reference to the arena
+    void _arena_release(_Arena *arena);
+    // arena will reference the containers of dep, false if it would be a cycle
+    bool _arena_depend(_Arena &arena, _Arena *dep);
+    // move the memory of src into arena, false if src is shared, depends on arena,
+    // or uses another allocator
+    bool _arena_merge(_Arena &arena, _Arena *src);
+    // copy src sharing the containers, src is owned by src_arena
+    void _share(_Arena &arena, _Node *dst, const _Node *src, _Arena *src_arena);
+    // the node no longer references its container, called before the node is overwritten,
+    // the children of the containers no longer referenced are dropped too
+    void _drop(_Arena &arena, const _Node *node);
+    // the tree of root is discarded with the arena, see _drop()
+    void _discard(_Arena &arena, const _Node *root);
+    // the container of node for writing, copied to arena if shared
+    _Array *_writable_arr(_Arena &arena, _Node *node);
+    _Map *_writable_map(_Arena &arena, _Node *node);
+
+    // a stack for the iterative walks of the trees, on the heap beyond the first levels
+    template <class T>
+    struct _Stack {
+        Allocator *allocator;
+        T *items;
+        size_t size;
+        size_t cap;
+        T local[32];
+
+        explicit _Stack(Allocator *allocator)
+            : allocator(allocator), items(local), size(0), cap(sizeof(local) / sizeof(T))
+        {}
+        ~_Stack() {
+            if (this->items != this->local) {
+                this->allocator->deallocate(this->items, this->cap * sizeof(T));
+            }
+        }
+        void push(T item) {
+            if (this->size == this->cap) {
+                this->grow();
+            }
+            this->items[this->size++] = item;
+        }
+        T top() const {
+            return this->items[this->size - 1];
+        }
+        void pop() {
+            this->size--;
+        }
+
+    private:
+        void grow() {
+            size_t ncap = this->cap * 2;
+            T *p = (T *)this->allocator->allocate(ncap * sizeof(T));
+            if (!p) {
+                _bad_alloc();
+            }
+            memcpy(p, this->items, this->size * sizeof(T));
+            if (this->items != this->local) {
+                this->allocator->deallocate(this->items, this->cap * sizeof(T));
+            }
+            this->items = p;
+            this->cap = ncap;
+        }
+        _Stack(const _Stack &);
+        _Stack &operator=(const _Stack &);
+    };
+
+    // from j_num.cpp
+    void _set_u64(_Arena &arena, _Node *node, uint64_t val);
+    void _set_i64(_Arena &arena, _Node *node, int64_t val);
+    void _set_double(_Arena &arena, _Node *node, double val);
+    void _set_float(_Arena &arena, _Node *node, float val);
+    // the text is allocated after the double, returns the text
+    char *_set_num(_Arena &arena, _Node *node, const char *data, size_t len, double val);
+    void _set_num(_Arena &arena, _Node *node, const char *data, size_t len);
+    // the text of a number, integers are formatted into buf
+    const char *_num_text(const _Node *node, char (&buf)[24], size_t *len);
+
+    // from j_parser.cpp
+    // decode the validated escapes of the raw text, returns the length written to out
+    size_t _unescape(const char *raw, size_t len, char *out);
+
+    // the length of the escape sequence at p, a high surrogate is decoded with the next \u
+    inline size_t _escape_len(const char *p, const char *end) {
+        if (p[1] != 'u') {
+            return 2;
+        }
+        bool high = (p[2] == 'd' || p[2] == 'D')
+            && (p[3] == '8' || p[3] == '9' || p[3] == 'a' || p[3] == 'b' || p[3] == 'A' || p[3] == 'B');
+        return (high && p + 12 <= end && p[6] == '\\' && p[7] == 'u') ? 12 : 6;
+    }
+
+    // from j_map.cpp
+    uint32_t _hash(const char *key, size_t len);
+    // append an entry, the previous entry with the same key is removed,
+    // the key is not copied if borrowed, see _borrow_text()
+    _Node *_map_push(_Arena &arena, _Map *map, const char *key, size_t len, bool borrow = false);
+    _Node *_map_find(const _Map *map, const char *key, size_t len);
+    bool _map_erase(_Arena &arena, _Map *map, const char *key, size_t len);
+    // remove the erased slots, the order is preserved
+    void _map_compact(_Arena &arena, _Map *map);
+    // remove all entries, the map starts with the empty shape
+    void _map_clear(_Arena &arena, _Map *map);
+
 }   // ::j
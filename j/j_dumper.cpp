@@ -7,9 +7,8 @@ namespace j {
 
     static const char *const k_hex = "0123456789abcdef";
 
-    static void dump_str(const Dumper &, const std::string &str, std::string &ans) {
-        ans.push_back('"');
-        for (size_t i = 0; i < str.size(); ++i) {
+    static void escape_str(const Dumper &, const char *str, size_t len, std::string &ans) {
+        for (size_t i = 0; i < len; ++i) {
             char ch = str[i];
             if (ch == '"' || ch == '\\') {
                 ans.push_back('\\');
@@ -22,11 +21,51 @@ namespace j {
                 ans.push_back(ch);
             }
         }
+    }
+
+    static void dump_str(const Dumper &opts, const char *str, size_t len, std::string &ans) {
+        ans.push_back('"');
+        escape_str(opts, str, len, ans);
         ans.push_back('"');
     }
 
-    static void dump_val(const Dumper &opts, _Node *ref, std::string &ans, uint32_t level) {
-        assert(ref->type != T_DEL);
+    // the raw text of F_ESCAPED, decoded by escape sequences without caching, the Doc is const
+    static void dump_raw(const Dumper &opts, const char *raw, size_t len, std::string &ans) {
+        const char *end = raw + len;
+        ans.push_back('"');
+        while (raw < end) {
+            const char *esc = (const char *)memchr(raw, '\\', end - raw);
+            if (!esc) {
+                esc = end;
+            }
+            // no quotes or control chars in the raw text
+            ans.append(raw, esc);
+            if (esc == end) {
+                break;
+            }
+            size_t n = _escape_len(esc, end);
+            char buf[8];
+            escape_str(opts, buf, _unescape(esc, n, buf), ans);
+            raw = esc + n;
+        }
+        ans.push_back('"');
+    }
+
+    // the separator before a value of a container
+    static void dump_sep(const Dumper &opts, bool first, std::string &ans, uint32_t level) {
+        if (!first) {
+            ans.push_back(',');
+            if (opts.indent == 0 && opts.spacing) {
+                ans.push_back(' ');
+            }
+        }
+        if (opts.indent > 0) {
+            ans.push_back('\n');
+            ans.append(opts.indent * level, ' ');
+        }
+    }
+
+    static void dump_scalar(const Dumper &opts, const _Node *ref, std::string &ans) {
         if (ref->type == T_NULL) {
             ans.append("null");
         } else if (ref->type == T_TRUE) {
@@ -34,64 +73,117 @@ namespace j {
         } else if (ref->type == T_FALSE) {
             ans.append("false");
         } else if (ref->type == T_NUM) {
-            ans.append(ref->val);
+            char buf[24];
+            size_t len = 0;
+            const char *text = _num_text(ref, buf, &len);
+            ans.append(text, len);
+        } else if (ref->type == T_STR && (ref->flags & F_ESCAPED)) {
+            dump_raw(opts, ref->str, ref->len, ans);
         } else if (ref->type == T_STR) {
-            dump_str(opts, ref->val, ans);
-        } else if (ref->type == T_ARR) {
-            ans.push_back('[');
-            bool first = true;
-            for (size_t i = 0; i < ref->values.size(); ++i) {
-                if (ref->values[i].type == T_DEL) {
-                    continue;   // caused by usage error
+            dump_str(opts, _text(ref), ref->len, ans);
+        } else {
+            assert(!"Unreachable");
+        }
+    }
+
+    // the open containers of dump_deep()
+    struct _DumpFrame {
+        const _Node *ref;
+        uint32_t i;         // the next child
+        bool first;
+    };
+
+    // NOTE: not recursive, the level of the top container is level + stack.size - 1
+    static void dump_deep(const Dumper &opts, const _Node *ref, std::string &ans, uint32_t level, Allocator *allocator) {
+        _Stack<_DumpFrame> stack(allocator);
+        while (ref) {
+            assert(ref->type != T_DEL);
+            if (ref->type == T_ARR || ref->type == T_MAP) {
+                ans.push_back(ref->type == T_ARR ? '[' : '{');
+                _DumpFrame frame = { ref, 0, true };
+                stack.push(frame);
+            } else {
+                dump_scalar(opts, ref, ans);
+            }
+
+            // the next value of the open containers
+            ref = NULL;
+            while (!ref && stack.size > 0) {
+                _DumpFrame &top = stack.items[stack.size - 1];
+                bool is_arr = top.ref->type == T_ARR;
+                const _Node *values = is_arr ? top.ref->arr->values : top.ref->map->values;
+                uint32_t size = is_arr ? top.ref->arr->size : top.ref->map->size;
+                while (top.i < size && values[top.i].type == T_DEL) {
+                    top.i++;
                 }
-                if (!first) {
-                    ans.push_back(',');
-                    if (opts.indent == 0 && opts.spacing) {
+                if (top.i == size) {
+                    if (!top.first && opts.indent > 0) {
+                        ans.push_back('\n');
+                    }
+                    ans.push_back(is_arr ? ']' : '}');
+                    stack.pop();
+                    continue;
+                }
+                dump_sep(opts, top.first, ans, level + (uint32_t)stack.size - 1);
+                top.first = false;
+                if (!is_arr) {
+                    const _Node *name = &top.ref->map->names[top.i];
+                    dump_str(opts, _text(name), name->len, ans);
+                    ans.push_back(':');
+                    if (opts.spacing) {
                         ans.push_back(' ');
                     }
                 }
-                if (opts.indent > 0) {
-                    ans.push_back('\n');
-                    ans.append(opts.indent * level, ' ');
+                ref = &values[top.i++];
+            }
+        }
+    }
+
+    // recursive for the first levels, faster than dump_deep()
+    static void dump_val(const Dumper &opts, const _Node *ref, std::string &ans, uint32_t level, Allocator *allocator) {
+        assert(ref->type != T_DEL);
+        if (level > k_recursion_depth) {
+            dump_deep(opts, ref, ans, level, allocator);
+        } else if (ref->type == T_ARR) {
+            const _Node *values = ref->arr->values;
+            ans.push_back('[');
+            bool first = true;
+            for (size_t i = 0; i < ref->arr->size; ++i) {
+                if (values[i].type == T_DEL) {
+                    continue;   // caused by usage error
                 }
+                dump_sep(opts, first, ans, level);
                 first = false;
-                dump_val(opts, &ref->values[i], ans, level + 1);
+                dump_val(opts, &values[i], ans, level + 1, allocator);
             }
             if (!first && opts.indent > 0) {
                 ans.push_back('\n');
             }
             ans.push_back(']');
         } else if (ref->type == T_MAP) {
+            const _Node *values = ref->map->values;
             ans.push_back('{');
             bool first = true;
-            for (size_t i = 0; i < ref->values.size(); ++i) {
-                if (ref->values[i].type == T_DEL) {
+            for (size_t i = 0; i < ref->map->size; ++i) {
+                if (values[i].type == T_DEL) {
                     continue;   // caused by deleted map entry
                 }
-                if (!first) {
-                    ans.push_back(',');
-                    if (opts.indent == 0 && opts.spacing) {
-                        ans.push_back(' ');
-                    }
-                }
-                if (opts.indent > 0) {
-                    ans.push_back('\n');
-                    ans.append(opts.indent * level, ' ');
-                }
+                dump_sep(opts, first, ans, level);
                 first = false;
-                dump_str(opts, ref->values[i].key, ans);
+                const _Node *name = &ref->map->names[i];
+                dump_str(opts, _text(name), name->len, ans);
                 ans.push_back(':');
                 if (opts.spacing) {
                     ans.push_back(' ');
                 }
-                dump_val(opts, &ref->values[i], ans, level + 1);
+                dump_val(opts, &values[i], ans, level + 1, allocator);
             }
             if (!first && opts.indent > 0) {
                 ans.push_back('\n');
             }
             ans.push_back('}');
         } else {
-            assert(!"Unreachable");
+            dump_scalar(opts, ref, ans);
         }
     }
 
@@ -100,7 +192,102 @@ namespace j {
         if (!doc.ref || doc.ref->type == T_DEL) {
             return ans;
         }
-        dump_val(*this, doc.ref, ans, 1);
+        dump_val(*this, doc.ref, ans, 1, doc.allocator);
+        return ans;
+    }
+
+    static void dump_frozen_scalar(const Dumper &opts, const FrozenDoc &doc, size_t i, std::string &ans) {
+        uint64_t e = doc.tape[i];
+        uint8_t type = _tape_type(e);
+        if (type == T_NULL) {
+            ans.append("null");
+        } else if (type == T_TRUE) {
+            ans.append("true");
+        } else if (type == T_FALSE) {
+            ans.append("false");
+        } else if (type == T_NUM && (_tape_flags(e) & F_INT)) {
+            _Node num;
+            _node_init(&num, T_NUM);
+            num.flags = _tape_flags(e);
+            num.u64 = doc.tape[i + 1];
+            char buf[24];
+            size_t len = 0;
+            const char *text = _num_text(&num, buf, &len);
+            ans.append(text, len);
+        } else if (type == T_NUM) {
+            uint32_t len = 0;
+            const char *text = _tape_text(doc.strs, e, &len);
+            ans.append(text, len);
+        } else if (type == T_STR) {
+            uint32_t len = 0;
+            const char *str = _tape_text(doc.strs, e, &len);
+            dump_str(opts, str, len, ans);
+        } else {
+            assert(!"Unreachable");
+        }
+    }
+
+    // the open containers of dump_frozen()
+    struct _FrozenDumpFrame {
+        size_t begin;       // the tape index of the container
+        size_t cur;         // the next child
+        size_t end;
+    };
+
+    // NOTE: not recursive, the same as dump_deep()
+    static void dump_frozen(const Dumper &opts, const FrozenDoc &doc, std::string &ans) {
+        _Stack<_FrozenDumpFrame> stack(doc.allocator);
+        size_t i = 0;
+        while (true) {
+            uint64_t e = doc.tape[i];
+            uint8_t type = _tape_type(e);
+            if (type == T_ARR || type == T_MAP) {
+                ans.push_back(type == T_ARR ? '[' : '{');
+                _FrozenDumpFrame frame = { i, i + 2, (size_t)_tape_payload(e) };
+                stack.push(frame);
+            } else {
+                dump_frozen_scalar(opts, doc, i, ans);
+            }
+
+            // the next value of the open containers
+            bool found = false;
+            while (!found && stack.size > 0) {
+                _FrozenDumpFrame &top = stack.items[stack.size - 1];
+                bool is_arr = _tape_type(doc.tape[top.begin]) == T_ARR;
+                if (top.cur == top.end) {
+                    if (top.end > top.begin + 2 && opts.indent > 0) {
+                        ans.push_back('\n');
+                    }
+                    ans.push_back(is_arr ? ']' : '}');
+                    stack.pop();
+                    continue;
+                }
+                dump_sep(opts, top.cur == top.begin + 2, ans, (uint32_t)stack.size);
+                if (!is_arr) {
+                    uint32_t len = 0;
+                    const char *name = _tape_text(doc.strs, doc.tape[top.cur], &len);
+                    dump_str(opts, name, len, ans);
+                    ans.push_back(':');
+                    if (opts.spacing) {
+                        ans.push_back(' ');
+                    }
+                    top.cur++;
+                }
+                i = top.cur;
+                top.cur = _tape_next(doc.tape, i);
+                found = true;
+            }
+            if (!found) {
+                break;
+            }
+        }
+    }
+
+    std::string Dumper::dump(const FrozenDoc &doc) const {
+        std::string ans;
+        if (doc.size > 0) {
+            dump_frozen(*this, doc, ans);
+        }
         return ans;
     }
 
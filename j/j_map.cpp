@@ -0,0 +1,465 @@
+// system
+#include <string.h>
+#include <assert.h>
+// proj
+#include "j.h"
+#include "j_def.h"
+
+
+namespace j {
+
+    static inline uint64_t _load64(const char *p) {
+        uint64_t v;
+        memcpy(&v, p, 8);
+        return v;
+    }
+
+    static inline uint64_t _mix(uint64_t h) {
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        return h;
+    }
+
+    uint32_t _hash(const char *key, size_t len) {
+        uint64_t h = 0x9e3779b97f4a7c15ULL ^ (len * 0xc2b2ae3d27d4eb4fULL);
+        while (len >= 8) {
+            h = (h ^ _load64(key)) * 0xbf58476d1ce4e5b9ULL;
+            h ^= h >> 29;
+            key += 8;
+            len -= 8;
+        }
+        uint64_t tail = 0;
+        memcpy(&tail, key, len);
+        h = _mix(h ^ tail);
+        return (uint32_t)(h ^ (h >> 32));
+    }
+
+    static inline void _set_name(_Arena &arena, _Node *name, const char *key, size_t len, bool borrow) {
+        if (borrow) {
+            _borrow_text(name, T_STR, key, len);
+        } else {
+            _set_text(arena, name, T_STR, key, len);
+        }
+    }
+
+    static inline bool _name_eq(const _Node *name, const char *key, size_t len) {
+        return name->len == len && 0 == memcmp(_text(name), key, len);
+    }
+
+    // NOTE: the name is marked T_DEL for erased entries,
+    // NOTE: a T_DEL value with a live name is a newly created node.
+    static void _remove_slot(_Arena &arena, _Map *map, uint32_t slot) {
+        _drop(arena, &map->values[slot]);
+        _relocate(arena, &map->values[slot], 1, NULL);
+        _node_init(&map->names[slot], T_DEL);
+        _node_init(&map->values[slot], T_DEL);
+    }
+
+    // linear scan, for small maps
+    static uint32_t _linear_find(const _Node *names, uint32_t size, const char *key, size_t len) {
+        for (uint32_t i = 0; i < size; ++i) {
+            if (names[i].type != T_DEL && _name_eq(&names[i], key, len)) {
+                return i;
+            }
+        }
+        return ~uint32_t(0);
+    }
+
+    // the position in the hash table of the key, or of the empty entry to insert it
+    static uint32_t _probe(
+        const _HashEntry *table, uint32_t mask, const _Node *names,
+        uint32_t hash, const char *key, size_t len)
+    {
+        uint32_t i = hash & mask;
+        while (true) {
+            const _HashEntry &e = table[i];
+            if (e.slot == 0) {
+                return i;
+            }
+            if (e.hash == hash && _name_eq(&names[e.slot - 1], key, len)) {
+                return i;
+            }
+            i = (i + 1) & mask;
+        }
+    }
+
+    static inline void _table_insert(_HashEntry *table, uint32_t mask, uint32_t hash, uint32_t slot) {
+        uint32_t i = hash & mask;
+        while (table[i].slot != 0) {
+            i = (i + 1) & mask;
+        }
+        table[i].hash = hash;
+        table[i].slot = slot;
+    }
+
+    // the hash table with the load factor under 0.5
+    static _HashEntry *_new_table(_Arena &arena, uint32_t count, uint32_t *mask) {
+        uint32_t tsize = 16;
+        while (tsize <= count * 2) {
+            tsize *= 2;
+        }
+        _HashEntry *table = (_HashEntry *)arena.alloc(sizeof(_HashEntry) * tsize);
+        memset((void *)table, 0, sizeof(_HashEntry) * tsize);
+        *mask = tsize - 1;
+        return table;
+    }
+
+    static void _index_names(_HashEntry *table, uint32_t mask, const _Node *names, uint32_t size) {
+        for (uint32_t slot = 0; slot < size; ++slot) {
+            if (names[slot].type != T_DEL) {
+                const _Node *name = &names[slot];
+                _table_insert(table, mask, _hash(_text(name), name->len), slot + 1);
+            }
+        }
+    }
+
+    static void _rehash(_Arena &arena, _Map *map) {
+        uint32_t mask = 0;
+        _HashEntry *table = _new_table(arena, map->count, &mask);
+        if (map->table) {
+            // reuse the cached hashes
+            for (uint32_t i = 0; i <= map->mask; ++i) {
+                if (map->table[i].slot != 0) {
+                    _table_insert(table, mask, map->table[i].hash, map->table[i].slot);
+                }
+            }
+        } else {
+            _index_names(table, mask, map->names, map->size);
+        }
+        map->table = table;
+        map->mask = mask;
+    }
+
+    // shapes
+    static _Shape *_root_shape(_Arena &arena) {
+        if (!arena.shapes) {
+            _Shape *root = (_Shape *)arena.alloc(sizeof(_Shape));
+            memset((void *)root, 0, sizeof(_Shape));
+            root->uses = 2;
+            arena.shapes = root;
+        }
+        return arena.shapes;
+    }
+
+    // the slot of the last lookup of the thread, the shape is shared by readers
+    static __thread uint32_t t_shape_hint;
+
+    static uint32_t _shape_find(const _Shape *shape, const char *key, size_t len) {
+        // repeated lookup of the same key, or of the next key, on the maps of the same shape
+        uint32_t hint = t_shape_hint;
+        if (hint < shape->count && _name_eq(&shape->names[hint], key, len)) {
+            return hint;
+        }
+        if (hint + 1 < shape->count && _name_eq(&shape->names[hint + 1], key, len)) {
+            t_shape_hint = hint + 1;
+            return hint + 1;
+        }
+
+        uint32_t slot;
+        if (!shape->table) {
+            slot = _linear_find(shape->names, shape->count, key, len);
+        } else {
+            const _HashEntry &e = shape->table[
+                _probe(shape->table, shape->mask, shape->names, _hash(key, len), key, len)];
+            slot = e.slot - 1;
+        }
+        if (slot != ~uint32_t(0)) {
+            t_shape_hint = slot;
+        }
+        return slot;
+    }
+
+    static inline uint32_t _child_hash(const _Shape *shape, const _Shape *child) {
+        const _Node *name = &child->names[shape->count];
+        return _hash(_text(name), name->len);
+    }
+
+    static void _index_children(_Arena &arena, _Shape *shape) {
+        uint32_t tsize = 16;
+        while (tsize <= shape->nchildren * 2) {
+            tsize *= 2;
+        }
+        _Transition *table = (_Transition *)arena.alloc(sizeof(_Transition) * tsize);
+        memset((void *)table, 0, sizeof(_Transition) * tsize);
+        uint32_t mask = tsize - 1;
+        for (_Shape *child = shape->children; child; child = child->sibling) {
+            uint32_t hash = _child_hash(shape, child);
+            uint32_t i = hash & mask;
+            while (table[i].shape) {
+                i = (i + 1) & mask;
+            }
+            table[i].hash = hash;
+            table[i].shape = child;
+        }
+        shape->child_table = table;
+        shape->child_mask = mask;
+    }
+
+    // the shape with the key appended if any
+    static _Shape *_shape_child(const _Shape *shape, const char *key, size_t len) {
+        if (!shape->child_table) {
+            for (_Shape *child = shape->children; child; child = child->sibling) {
+                if (_name_eq(&child->names[shape->count], key, len)) {
+                    return child;
+                }
+            }
+            return NULL;
+        }
+        uint32_t hash = _hash(key, len);
+        for (uint32_t i = hash & shape->child_mask; shape->child_table[i].shape; i = (i + 1) & shape->child_mask) {
+            const _Transition &t = shape->child_table[i];
+            if (t.hash == hash && _name_eq(&t.shape->names[shape->count], key, len)) {
+                return t.shape;
+            }
+        }
+        return NULL;
+    }
+
+    // the shape with the key appended, NULL if the key is duplicated, there are too many keys,
+    // or no other map took the shape
+    static _Shape *_shape_add(_Arena &arena, _Shape *shape, const char *key, size_t len, bool borrow) {
+        if (_Shape *child = _shape_child(shape, key, len)) {
+            if (child->uses < 2) {
+                child->uses = 2;
+                if (child->count > k_linear_keys) {
+                    // NOTE: built by the writer when the shape is reused, never by the readers
+                    child->table = _new_table(arena, child->count, &child->mask);
+                    _index_names(child->table, child->mask, child->names, child->count);
+                }
+            }
+            return child;
+        }
+        if (shape->uses < 2 || shape->count >= k_max_shape_keys || _shape_find(shape, key, len) != ~uint32_t(0)) {
+            return NULL;
+        }
+
+        // take the next name of the buffer if no other child did
+        _NameBuf *buf = shape->buf;
+        if (!buf || buf->used != shape->count || buf->used == buf->cap) {
+            _NameBuf *nbuf = (_NameBuf *)arena.alloc(sizeof(_NameBuf));
+            // NOTE: a branch is rarely extended (e.g. maps keyed by ids), no room to spare
+            if (shape->children) {
+                nbuf->cap = shape->count + 1;
+            } else {
+                nbuf->cap = shape->count < 4 ? 8 : shape->count * 2;
+            }
+            nbuf->names = (_Node *)arena.alloc(sizeof(_Node) * nbuf->cap);
+            if (shape->count > 0) {
+                memcpy((void *)nbuf->names, (const void *)shape->names, sizeof(_Node) * shape->count);
+            }
+            nbuf->used = shape->count;
+            buf = nbuf;
+        }
+        _set_name(arena, &buf->names[buf->used++], key, len, borrow);
+
+        _Shape *child = (_Shape *)arena.alloc(sizeof(_Shape));
+        memset((void *)child, 0, sizeof(_Shape));
+        child->count = shape->count + 1;
+        child->names = buf->names;
+        child->buf = buf;
+        child->uses = 1;
+        child->sibling = shape->children;
+        shape->children = child;
+        shape->nchildren++;
+        if (shape->nchildren > k_linear_keys) {
+            if (!shape->child_table || shape->nchildren * 2 > shape->child_mask + 1) {
+                _index_children(arena, shape);
+            } else {
+                uint32_t hash = _child_hash(shape, child);
+                uint32_t i = hash & shape->child_mask;
+                while (shape->child_table[i].shape) {
+                    i = (i + 1) & shape->child_mask;
+                }
+                shape->child_table[i].hash = hash;
+                shape->child_table[i].shape = child;
+            }
+        }
+        return child;
+    }
+
+    // become a dictionary with its own keys
+    static void _unshape(_Arena &arena, _Map *map) {
+        _Node *names = (_Node *)arena.alloc(sizeof(_Node) * map->cap);
+        if (map->size > 0) {
+            memcpy((void *)names, (const void *)map->names, sizeof(_Node) * map->size);
+        }
+        map->names = names;
+        map->shape = NULL;
+        map->table = NULL;
+        map->mask = 0;
+        if (map->size > k_linear_keys) {
+            _rehash(arena, map);
+        }
+    }
+
+    _Node *_map_push(_Arena &arena, _Map *map, const char *key, size_t len, bool borrow) {
+        if (map->shape) {
+            _Shape *shape = _shape_add(arena, map->shape, key, len, borrow);
+            if (shape) {
+                if (map->size == map->cap) {
+                    map->values = _grow(arena, map->values, map->size, &map->cap);
+                }
+                map->shape = shape;
+                map->names = shape->names;
+                _Node *node = &map->values[map->size++];
+                _node_init(node, T_DEL);
+                map->count++;
+                return node;
+            }
+            _unshape(arena, map);
+        }
+
+        if (map->size == map->cap && map->size - map->count >= map->size / k_compact_ratio) {
+            // reuse the erased slots instead of growing
+            _map_compact(arena, map);
+        }
+        uint32_t slot = map->size;
+        if (map->mask == 0 && slot >= k_linear_keys) {
+            _rehash(arena, map);
+        }
+
+        // link
+        if (map->mask == 0) {
+            uint32_t prev = _linear_find(map->names, map->size, key, len);
+            if (prev != ~uint32_t(0)) {
+                // remove previous key
+                _remove_slot(arena, map, prev);
+            } else {
+                map->count++;
+            }
+        } else {
+            uint32_t hash = _hash(key, len);
+            _HashEntry &e = map->table[_probe(map->table, map->mask, map->names, hash, key, len)];
+            if (e.slot != 0) {
+                // remove previous key
+                _remove_slot(arena, map, e.slot - 1);
+            } else {
+                e.hash = hash;
+                map->count++;
+            }
+            e.slot = slot + 1;
+        }
+
+        // append
+        if (map->size == map->cap) {
+            uint32_t cap = map->cap;
+            map->names = _grow(arena, map->names, map->size, &cap);
+            map->values = _grow(arena, map->values, map->size, &map->cap);
+        }
+        _set_name(arena, &map->names[slot], key, len, borrow);
+        _Node *node = &map->values[slot];
+        _node_init(node, T_DEL);
+        map->size++;
+
+        if (map->mask != 0 && map->count * 2 > map->mask + 1) {
+            _rehash(arena, map);
+        }
+        return node;
+    }
+
+    _Node *_map_find(const _Map *map, const char *key, size_t len) {
+        uint32_t slot;
+        if (map->shape) {
+            slot = _shape_find(map->shape, key, len);
+        } else if (map->mask == 0) {
+            slot = _linear_find(map->names, map->size, key, len);
+        } else {
+            const _HashEntry &e = map->table[
+                _probe(map->table, map->mask, map->names, _hash(key, len), key, len)];
+            slot = e.slot - 1;
+        }
+        return slot != ~uint32_t(0) ? &map->values[slot] : NULL;
+    }
+
+    bool _map_erase(_Arena &arena, _Map *map, const char *key, size_t len) {
+        if (map->shape) {
+            if (_shape_find(map->shape, key, len) == ~uint32_t(0)) {
+                return false;
+            }
+            _unshape(arena, map);
+        }
+
+        if (map->mask == 0) {
+            uint32_t slot = _linear_find(map->names, map->size, key, len);
+            if (slot == ~uint32_t(0)) {
+                return false;
+            }
+            _remove_slot(arena, map, slot);
+            map->count--;
+            return true;
+        }
+
+        uint32_t hole = _probe(map->table, map->mask, map->names, _hash(key, len), key, len);
+        _HashEntry *table = map->table;
+        if (table[hole].slot == 0) {
+            return false;
+        }
+        _remove_slot(arena, map, table[hole].slot - 1);
+        map->count--;
+
+        // backward shift deletion, keep the probe sequences unbroken
+        uint32_t i = hole;
+        while (true) {
+            i = (i + 1) & map->mask;
+            if (table[i].slot == 0) {
+                break;
+            }
+            uint32_t home = table[i].hash & map->mask;
+            if (((i - home) & map->mask) >= ((i - hole) & map->mask)) {
+                table[hole] = table[i];
+                hole = i;
+            }
+        }
+        table[hole].slot = 0;
+        return true;
+    }
+
+    void _map_compact(_Arena &arena, _Map *map) {
+        if (map->size == map->count) {
+            return;     // no erased slots, including maps with shape
+        }
+        uint32_t n = 0;
+        for (uint32_t i = 0; i < map->size; ++i) {
+            if (map->names[i].type != T_DEL) {
+                if (n != i) {
+                    map->names[n] = map->names[i];
+                    map->values[n] = map->values[i];
+                    _relocate(arena, &map->values[i], 1, &map->values[n]);
+                }
+                n++;
+            }
+        }
+        map->size = n;
+        assert(map->size == map->count);
+
+        // rebuild the index, reuse the table
+        if (map->size > k_linear_keys && map->table) {
+            memset((void *)map->table, 0, sizeof(_HashEntry) * (map->mask + 1));
+            _index_names(map->table, map->mask, map->names, map->size);
+        } else {
+            map->table = NULL;
+            map->mask = 0;
+            if (map->size > k_linear_keys) {
+                _rehash(arena, map);
+            }
+        }
+    }
+
+    void _map_clear(_Arena &arena, _Map *map) {
+        if (map->values) {
+            for (uint32_t i = 0; i < map->size; ++i) {
+                _drop(arena, &map->values[i]);
+            }
+            _relocate(arena, map->values, map->size, NULL);
+        }
+        _Shape *root = _root_shape(arena);
+        map->size = 0;
+        map->count = 0;
+        map->mask = 0;
+        map->names = root->names;
+        map->table = NULL;
+        map->shape = root;
+    }
+
+}   // ::j
@@ -1,5 +1,9 @@
 // system
 #include <string.h>
+#if defined(__GNUC__) && defined(__SSE2__)
+#   include <immintrin.h>
+#   define J_SSE2 1
+#endif
 // proj
 #include "j.h"
 #include "j_def.h"
@@ -7,66 +11,413 @@
 
 namespace j {
 
-    struct _ParseError {
-        const char *pos;
-        std::string err;
+    // NOTE: the parse functions return NULL or the error message, cur is left at the error.
+    // NOTE: no exceptions, rejecting an input costs the same as accepting it.
 
-        _ParseError(const char *pos, const std::string &err)
-            : pos(pos), err(err)
-        {}
-    };
+    static inline bool is_space(char ch) {
+        return ch == ' ' || ch == '\t' || ch == '\n' || ch == '\r';
+    }
+
+    static const char *skip_space_scalar(const char *cur, const char *end) {
+        while (cur < end && is_space(*cur)) {
+            cur++;
+        }
+        return cur;
+    }
+
+    // the chars without escapes, stop at the quote, the backslash or control chars
+    static inline bool is_plain(char ch) {
+        return ch != '"' && ch != '\\' && (uint8_t)ch > 0x1F;
+    }
+
+    static const char *skip_plain_scalar(const char *cur, const char *end) {
+        while (cur < end && is_plain(*cur)) {
+            cur++;
+        }
+        return cur;
+    }
+
+    // the plain chars of the valid UTF-8, returns the first special char, the first byte of the invalid sequence,
+    // or end if the input ends before the string
+    static const char *skip_plain_utf8_scalar(const char *cur, const char *end) {
+        while (cur < end) {
+            uint8_t lead = (uint8_t)cur[0];
+            if (lead < 0x80) {
+                if (!is_plain(lead)) {
+                    return cur;
+                }
+                cur++;
+                continue;
+            }
+            // the range of the second byte excludes the overlongs, the surrogates and the values above U+10FFFF
+            ptrdiff_t n = 0;
+            uint8_t lo = 0x80;
+            uint8_t hi = 0xBF;
+            if (lead < 0xC2) {
+                return cur;
+            } else if (lead < 0xE0) {
+                n = 2;
+            } else if (lead < 0xF0) {
+                n = 3;
+                lo = lead == 0xE0 ? 0xA0 : lo;
+                hi = lead == 0xED ? 0x9F : hi;
+            } else if (lead < 0xF5) {
+                n = 4;
+                lo = lead == 0xF0 ? 0x90 : lo;
+                hi = lead == 0xF4 ? 0x8F : hi;
+            } else {
+                return cur;
+            }
+            for (ptrdiff_t i = 1; i < n; ++i) {
+                if (end - cur <= i) {
+                    return end;
+                }
+                uint8_t ch = (uint8_t)cur[i];
+                if (i == 1 ? (ch < lo || ch > hi) : (ch & 0xC0) != 0x80) {
+                    return cur;
+                }
+            }
+            cur += n;
+        }
+        return cur;
+    }
+
+    typedef const char *(*_SkipFunc)(const char *cur, const char *end);
+
+#if defined(J_SSE2)
+    static inline uint32_t space_mask_sse2(__m128i v) {
+        __m128i m = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\t'))),
+            _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\r'))));
+        return (uint32_t)_mm_movemask_epi8(m);
+    }
+
+    // the quotes, the backslashes and the control chars
+    static inline uint32_t special_mask_sse2(__m128i v) {
+        __m128i ctrl = _mm_cmpeq_epi8(_mm_min_epu8(v, _mm_set1_epi8(0x1F)), v);
+        __m128i m = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('"')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\\'))), ctrl);
+        return (uint32_t)_mm_movemask_epi8(m);
+    }
+
+    // 16 bytes per step
+    static const char *skip_space_sse2(const char *cur, const char *end) {
+        while (end - cur >= 16) {
+            uint32_t mask = ~space_mask_sse2(_mm_loadu_si128((const __m128i *)cur)) & 0xffff;
+            if (mask) {
+                return cur + __builtin_ctz(mask);
+            }
+            cur += 16;
+        }
+        return skip_space_scalar(cur, end);
+    }
+
+    static const char *skip_plain_sse2(const char *cur, const char *end) {
+        while (end - cur >= 16) {
+            uint32_t mask = special_mask_sse2(_mm_loadu_si128((const __m128i *)cur));
+            if (mask) {
+                return cur + __builtin_ctz(mask);
+            }
+            cur += 16;
+        }
+        return skip_plain_scalar(cur, end);
+    }
+
+    // 32 bytes per step
+    __attribute__((target("avx2")))
+    static const char *skip_space_avx2(const char *cur, const char *end) {
+        const __m256i sp = _mm256_set1_epi8(' ');
+        const __m256i tab = _mm256_set1_epi8('\t');
+        const __m256i lf = _mm256_set1_epi8('\n');
+        const __m256i cr = _mm256_set1_epi8('\r');
+        while (end - cur >= 32) {
+            __m256i v = _mm256_loadu_si256((const __m256i *)cur);
+            __m256i m = _mm256_or_si256(
+                _mm256_or_si256(_mm256_cmpeq_epi8(v, sp), _mm256_cmpeq_epi8(v, tab)),
+                _mm256_or_si256(_mm256_cmpeq_epi8(v, lf), _mm256_cmpeq_epi8(v, cr)));
+            uint32_t mask = ~(uint32_t)_mm256_movemask_epi8(m);
+            if (mask) {
+                return cur + __builtin_ctz(mask);
+            }
+            cur += 32;
+        }
+        return skip_space_sse2(cur, end);
+    }
+
+    __attribute__((target("avx2")))
+    static const char *skip_plain_avx2(const char *cur, const char *end) {
+        const __m256i quote = _mm256_set1_epi8('"');
+        const __m256i bs = _mm256_set1_epi8('\\');
+        const __m256i ctrl = _mm256_set1_epi8(0x1F);
+        while (end - cur >= 32) {
+            __m256i v = _mm256_loadu_si256((const __m256i *)cur);
+            __m256i m = _mm256_or_si256(
+                _mm256_or_si256(_mm256_cmpeq_epi8(v, quote), _mm256_cmpeq_epi8(v, bs)),
+                _mm256_cmpeq_epi8(_mm256_min_epu8(v, ctrl), v));
+            uint32_t mask = (uint32_t)_mm256_movemask_epi8(m);
+            if (mask) {
+                return cur + __builtin_ctz(mask);
+            }
+            cur += 32;
+        }
+        return skip_plain_sse2(cur, end);
+    }
+
+    // unsigned v >= c
+    static inline __m128i ge_epu8_sse2(__m128i v, uint8_t c) {
+        return _mm_cmpeq_epi8(_mm_max_epu8(v, _mm_set1_epi8(char(c))), v);
+    }
+
+    // the errors of the UTF-8 by comparisons, no pshufb for the lookup in SSE2, prev is the previous 16 bytes
+    static inline __m128i utf8_errors_sse2(__m128i v, __m128i prev) {
+        // the bytes before each byte
+        __m128i prev1 = _mm_or_si128(_mm_slli_si128(v, 1), _mm_srli_si128(prev, 15));
+        __m128i prev2 = _mm_or_si128(_mm_slli_si128(v, 2), _mm_srli_si128(prev, 14));
+        __m128i prev3 = _mm_or_si128(_mm_slli_si128(v, 3), _mm_srli_si128(prev, 13));
+
+        // a continuation iff one of the 3 bytes before it starts a long enough sequence
+        __m128i cont = _mm_cmplt_epi8(v, _mm_set1_epi8(char(0xC0)));
+        __m128i must = _mm_or_si128(
+            ge_epu8_sse2(prev1, 0xC0), _mm_or_si128(ge_epu8_sse2(prev2, 0xE0), ge_epu8_sse2(prev3, 0xF0)));
+        __m128i err = _mm_xor_si128(cont, must);
+        // C0, C1 and F5 to FF are never in UTF-8
+        err = _mm_or_si128(err, _mm_or_si128(
+            ge_epu8_sse2(v, 0xF5), _mm_cmpeq_epi8(_mm_and_si128(v, _mm_set1_epi8(char(0xFE))), _mm_set1_epi8(char(0xC0)))));
+        // the second bytes of the overlongs, the surrogates and the values above U+10FFFF
+        __m128i ge_a0 = ge_epu8_sse2(v, 0xA0);
+        __m128i ge_90 = ge_epu8_sse2(v, 0x90);
+        __m128i range = _mm_or_si128(
+            _mm_or_si128(
+                _mm_andnot_si128(ge_a0, _mm_cmpeq_epi8(prev1, _mm_set1_epi8(char(0xE0)))),
+                _mm_and_si128(ge_a0, _mm_cmpeq_epi8(prev1, _mm_set1_epi8(char(0xED))))),
+            _mm_or_si128(
+                _mm_andnot_si128(ge_90, _mm_cmpeq_epi8(prev1, _mm_set1_epi8(char(0xF0)))),
+                _mm_and_si128(ge_90, _mm_cmpeq_epi8(prev1, _mm_set1_epi8(char(0xF4))))));
+        return _mm_or_si128(err, range);
+    }
+
+    // 16 bytes per step
+    // NOTE: the errors are located by skip_plain_utf8_scalar() from the start
+    static const char *skip_plain_utf8_sse2(const char *begin, const char *end) {
+        const char *cur = begin;
+        __m128i prev = _mm_setzero_si128();
+        __m128i err = _mm_setzero_si128();
+        __m128i v;
+        uint32_t mask = 0;
+        while (true) {
+            if (end - cur >= 16) {
+                v = _mm_loadu_si128((const __m128i *)cur);
+            } else {
+                // padded with zeros, which stop the string and catch the truncated sequence at the end
+                char tail[16];
+                memset(tail, 0, sizeof(tail));
+                memcpy(tail, cur, end - cur);
+                v = _mm_loadu_si128((const __m128i *)tail);
+            }
+            mask = special_mask_sse2(v);
+            if (mask) {
+                break;
+            }
+            // NOTE: the ASCII after the complete sequences has no errors
+            if (_mm_movemask_epi8(_mm_or_si128(v, prev))) {
+                err = _mm_or_si128(err, utf8_errors_sse2(v, prev));
+            }
+            prev = v;
+            cur += 16;
+        }
+        // the errors of the last step up to the special char, which is an error after the truncated sequence
+        uint32_t last = (uint32_t)_mm_movemask_epi8(utf8_errors_sse2(v, prev));
+        if ((last & (mask ^ (mask - 1))) || _mm_movemask_epi8(err)) {
+            return skip_plain_utf8_scalar(begin, end);
+        }
+        return cur + __builtin_ctz(mask);
+    }
+
+    // the errors of the UTF-8 by the lookup of Keiser and Lemire, from the high nibble and the low nibble
+    // of the previous byte and the high nibble of the current byte, prev is the previous 32 bytes
+    __attribute__((target("avx2")))
+    static inline __m256i utf8_errors_avx2(__m256i v, __m256i prev) {
+        // 0x01: a lead byte not followed by a continuation, 0x02: a continuation after an ASCII,
+        // 0x04: overlong 3 bytes, 0x08: above U+10FFFF, 0x10: surrogate, 0x20: overlong 2 bytes,
+        // 0x40: overlong 4 bytes or above U+10FFFF, 0x80: two continuations
+        const __m256i byte1_high = _mm256_setr_epi8(
+            0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x80, 0x80, 0x80, 0x80, 0x21, 0x01, 0x15, 0x49,
+            0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x80, 0x80, 0x80, 0x80, 0x21, 0x01, 0x15, 0x49);
+        const __m256i byte1_low = _mm256_setr_epi8(
+            0xE7, 0xA3, 0x83, 0x83, 0x8B, 0xCB, 0xCB, 0xCB, 0xCB, 0xCB, 0xCB, 0xCB, 0xCB, 0xDB, 0xCB, 0xCB,
+            0xE7, 0xA3, 0x83, 0x83, 0x8B, 0xCB, 0xCB, 0xCB, 0xCB, 0xCB, 0xCB, 0xCB, 0xCB, 0xDB, 0xCB, 0xCB);
+        const __m256i byte2_high = _mm256_setr_epi8(
+            0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0xE6, 0xAE, 0xBA, 0xBA, 0x01, 0x01, 0x01, 0x01,
+            0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0xE6, 0xAE, 0xBA, 0xBA, 0x01, 0x01, 0x01, 0x01);
+        const __m256i nibble = _mm256_set1_epi8(0x0F);
+
+        // the bytes before each byte
+        __m256i shifted = _mm256_permute2x128_si256(prev, v, 0x21);
+        __m256i prev1 = _mm256_alignr_epi8(v, shifted, 15);
+        __m256i prev2 = _mm256_alignr_epi8(v, shifted, 14);
+        __m256i prev3 = _mm256_alignr_epi8(v, shifted, 13);
+
+        __m256i special = _mm256_and_si256(
+            _mm256_and_si256(
+                _mm256_shuffle_epi8(byte1_high, _mm256_and_si256(_mm256_srli_epi16(prev1, 4), nibble)),
+                _mm256_shuffle_epi8(byte1_low, _mm256_and_si256(prev1, nibble))),
+            _mm256_shuffle_epi8(byte2_high, _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble)));
+        // the third and the fourth bytes must be continuations, which are the expected two continuations
+        __m256i third = _mm256_subs_epu8(prev2, _mm256_set1_epi8(char(0xE0 - 0x80)));
+        __m256i fourth = _mm256_subs_epu8(prev3, _mm256_set1_epi8(char(0xF0 - 0x80)));
+        __m256i must = _mm256_and_si256(_mm256_or_si256(third, fourth), _mm256_set1_epi8(char(0x80)));
+        return _mm256_xor_si256(must, special);
+    }
+
+    // 32 bytes per step
+    // NOTE: the errors are located by skip_plain_utf8_scalar() from the start
+    __attribute__((target("avx2")))
+    static const char *skip_plain_utf8_avx2(const char *begin, const char *end) {
+        const __m256i quote = _mm256_set1_epi8('"');
+        const __m256i bs = _mm256_set1_epi8('\\');
+        const __m256i ctrl = _mm256_set1_epi8(0x1F);
+        const char *cur = begin;
+        __m256i prev = _mm256_setzero_si256();
+        __m256i err = _mm256_setzero_si256();
+        __m256i v;
+        uint32_t mask = 0;
+        while (true) {
+            if (end - cur >= 32) {
+                v = _mm256_loadu_si256((const __m256i *)cur);
+            } else {
+                // padded with zeros, which stop the string and catch the truncated sequence at the end
+                char tail[32];
+                memset(tail, 0, sizeof(tail));
+                memcpy(tail, cur, end - cur);
+                v = _mm256_loadu_si256((const __m256i *)tail);
+            }
+            __m256i m = _mm256_or_si256(
+                _mm256_or_si256(_mm256_cmpeq_epi8(v, quote), _mm256_cmpeq_epi8(v, bs)),
+                _mm256_cmpeq_epi8(_mm256_min_epu8(v, ctrl), v));
+            mask = (uint32_t)_mm256_movemask_epi8(m);
+            if (mask) {
+                break;
+            }
+            // NOTE: the ASCII after the complete sequences has no errors
+            if (_mm256_movemask_epi8(_mm256_or_si256(v, prev))) {
+                err = _mm256_or_si256(err, utf8_errors_avx2(v, prev));
+            }
+            prev = v;
+            cur += 32;
+        }
+        // the errors of the last step up to the special char, which is an error after the truncated sequence
+        __m256i last = _mm256_cmpeq_epi8(utf8_errors_avx2(v, prev), _mm256_setzero_si256());
+        if ((~(uint32_t)_mm256_movemask_epi8(last) & (mask ^ (mask - 1))) || !_mm256_testz_si256(err, err)) {
+            // NOTE: gcc may leave the upper halves dirty before the tail call, which slows the SSE code after it
+            _mm256_zeroupper();
+            return skip_plain_utf8_scalar(begin, end);
+        }
+        return cur + __builtin_ctz(mask);
+    }
+
+    static const char *skip_space_resolve(const char *cur, const char *end);
+    static const char *skip_plain_resolve(const char *cur, const char *end);
+    static const char *skip_plain_utf8_resolve(const char *cur, const char *end);
+    // NOTE: constant initialized, so they work before the static constructors of this file
+    static _SkipFunc g_skip_space_run = skip_space_resolve;
+    static _SkipFunc g_skip_plain_run = skip_plain_resolve;
+    static _SkipFunc g_skip_plain_utf8_run = skip_plain_utf8_resolve;
+
+    static void simd_resolve() {
+        __builtin_cpu_init();
+        bool avx2 = __builtin_cpu_supports("avx2");
+        // NOTE: racing threads store the same values
+        g_skip_space_run = avx2 ? skip_space_avx2 : skip_space_sse2;
+        g_skip_plain_run = avx2 ? skip_plain_avx2 : skip_plain_sse2;
+        g_skip_plain_utf8_run = avx2 ? skip_plain_utf8_avx2 : skip_plain_utf8_sse2;
+    }
+
+    static const char *skip_space_resolve(const char *cur, const char *end) {
+        simd_resolve();
+        return g_skip_space_run(cur, end);
+    }
+
+    static const char *skip_plain_resolve(const char *cur, const char *end) {
+        simd_resolve();
+        return g_skip_plain_run(cur, end);
+    }
 
-    static void skip_space(const char *&cur, const char *end) {
-        while (cur < end && (*cur == ' ' || *cur == '\t' || *cur == '\n' || *cur == '\r')) {
+    static const char *skip_plain_utf8_resolve(const char *cur, const char *end) {
+        simd_resolve();
+        return g_skip_plain_utf8_run(cur, end);
+    }
+#else
+    static const _SkipFunc g_skip_space_run = skip_space_scalar;
+    static const _SkipFunc g_skip_plain_run = skip_plain_scalar;
+    static const _SkipFunc g_skip_plain_utf8_run = skip_plain_utf8_scalar;
+#endif
+
+    // returns the first non-space char or end
+    static inline const char *find_token(const char *cur, const char *end) {
+        // NOTE: most tokens are preceded by none or a single space, keep them out of the vector code
+        if (cur < end && is_space(*cur)) {
             cur++;
+            if (cur < end && is_space(*cur)) {
+                cur = g_skip_space_run(cur, end);
+            }
         }
+        return cur;
+    }
+
+    static const char *skip_space(const char *&cur, const char *end) {
+        cur = find_token(cur, end);
         if (cur >= end) {
-            throw _ParseError(cur, "unexpected eof");
+            return "unexpected eof";
         }
+        return NULL;
     }
 
-    static void skip_comment(const char *&cur, const char *end) {
+    static const char *skip_comment(const char *&cur, const char *end) {
         if (cur + 2 <= end && cur[0] == '/' && cur[1] == '/') {
             cur += 2;
-            while (cur < end && *cur != '\n') {
-                cur++;
-            }
+            const char *nl = (const char *)memchr(cur, '\n', end - cur);
+            cur = nl ? nl : end;
         } else if (cur + 2 <= end && cur[0] == '/' && cur[1] == '*') {
             cur += 2;
             while (cur + 2 <= end) {
                 if (cur[0] == '*' && cur[1] == '/') {
                     cur += 2;
-                    return;
+                    return NULL;
                 }
                 cur++;
             }
-            throw _ParseError(cur, "unexpected end of block comment");
+            return "unexpected end of block comment";
         }
+        return NULL;
     }
 
-    static void skip_to_token(const Parser &parser, const char *&cur, const char *end) {
+    static const char *skip_to_token(const Parser &parser, const char *&cur, const char *end) {
         if (!parser.allow_comment) {
             return skip_space(cur, end);
         }
 
         while (true) {
             const char *saved = cur;
-            skip_space(cur, end);
-            skip_comment(cur, end);
+            if (const char *err = skip_space(cur, end)) {
+                return err;
+            }
+            if (const char *err = skip_comment(cur, end)) {
+                return err;
+            }
             if (saved == cur) {
-                return;
+                return NULL;
             }
         }
     }
 
-    static void skip_to_eof(const Parser &parser, const char *&cur, const char *end) {
+    static const char *skip_to_eof(const Parser &parser, const char *&cur, const char *end) {
         while (true) {
             const char *saved = cur;
-            while (cur < end && (*cur == ' ' || *cur == '\t' || *cur == '\n' || *cur == '\r')) {
-                cur++;
-            }
+            cur = find_token(cur, end);
             if (parser.allow_comment) {
-                skip_comment(cur, end);
+                if (const char *err = skip_comment(cur, end)) {
+                    return err;
+                }
             }
             if (saved == cur) {
                 break;
@@ -74,15 +425,9 @@ namespace j {
         }
 
         if (cur < end) {
-            throw _ParseError(cur, "trailing garbage");
+            return "trailing garbage";
         }
-    }
-
-    static void expect_char(const char *&cur, const char *end, char ch, const char *name) {
-        if (cur >= end || *cur != ch) {
-            throw _ParseError(cur, std::string("expect ") + name);
-        }
-        cur++;
+        return NULL;
     }
 
     static bool maybe_char(const char *&cur, const char *end, char ch) {
@@ -94,9 +439,13 @@ namespace j {
         }
     }
 
-    static bool maybe_char_sp(const Parser &parser, const char *&cur, const char *end, char ch) {
-        skip_to_token(parser, cur, end);
-        return maybe_char(cur, end, ch);
+    // skip to the next token, which is consumed if it is ch
+    static const char *maybe_char_sp(const Parser &parser, const char *&cur, const char *end, char ch, bool *found) {
+        if (const char *err = skip_to_token(parser, cur, end)) {
+            return err;
+        }
+        *found = maybe_char(cur, end, ch);
+        return NULL;
     }
 
     static bool maybe_tok(const char *&cur, const char *end, const char *str) {
@@ -131,62 +480,48 @@ namespace j {
         0xff, 0xff, 0xff, 0xff, 0xff
     };
 
-    static uint32_t parse_hex(const char *&cur, const char *end) {
+    // 4 hex digits, decoded later by decode_hex()
+    static const char *expect_hex(const char *&cur, const char *end) {
         if (cur + 4 > end) {
-            throw _ParseError(cur, "expect 4 hex digits");
+            return "expect 4 hex digits";
         }
         uint32_t d0 = k_hex_numbers[(uint8_t)cur[0]];
         uint32_t d1 = k_hex_numbers[(uint8_t)cur[1]];
         uint32_t d2 = k_hex_numbers[(uint8_t)cur[2]];
         uint32_t d3 = k_hex_numbers[(uint8_t)cur[3]];
         if (d0 == 0xff || d1 == 0xff || d2 == 0xff || d3 == 0xff) {
-            throw _ParseError(cur, "not hex digits");
+            return "not hex digits";
         }
         cur += 4;
-        return (d0 << 12) | (d1 << 8) | (d2 << 4) | d3;
+        return NULL;
     }
 
-    static void utf8_encode(uint32_t code, std::string &ans) {
+    // returns the end of the output
+    static char *utf8_encode(uint32_t code, char *out) {
         if (code <= 0x7f) {
-            ans.push_back(code);
+            *out++ = code;
         } else if (code <= 0x7ff) {
-            ans.push_back(0b11000000 | (code >> 6));
-            ans.push_back(0b10000000 | (code & 0b00111111));
+            *out++ = 0b11000000 | (code >> 6);
+            *out++ = 0b10000000 | (code & 0b00111111);
         } else if (code <= 0xffff) {
-            ans.push_back(0b11100000 | (code >> 12));
-            ans.push_back(0b10000000 | ((code >> 6) & 0b00111111));
-            ans.push_back(0b10000000 | (code & 0b00111111));
+            *out++ = 0b11100000 | (code >> 12);
+            *out++ = 0b10000000 | ((code >> 6) & 0b00111111);
+            *out++ = 0b10000000 | (code & 0b00111111);
         } else if (code <= 0x10ffff) {
-            ans.push_back(0b11110000 | (code >> 18));
-            ans.push_back(0b10000000 | ((code >> 12) & 0b00111111));
-            ans.push_back(0b10000000 | ((code >> 6) & 0b00111111));
-            ans.push_back(0b10000000 | (code & 0b00111111));
+            *out++ = 0b11110000 | (code >> 18);
+            *out++ = 0b10000000 | ((code >> 12) & 0b00111111);
+            *out++ = 0b10000000 | ((code >> 6) & 0b00111111);
+            *out++ = 0b10000000 | (code & 0b00111111);
         } else {
             assert(!"Unreachable");
         }
+        return out;
     }
 
-    static void parse_u(const char *&cur, const char *end, std::string &ans) {
-        // decode code point
-        uint32_t code = parse_hex(cur, end);
-        if (0xd800 <= code && code <= 0xdbff) {
-            // UTF-16 surrogate pair
-            if (cur + 2 <= end && cur[0] == '\\' && cur[1] == 'u') {
-                cur += 2;
-                uint32_t lo_code = parse_hex(cur, end);
-                if (0xdc00 <= lo_code && lo_code <= 0xdfff) {
-                    code = 0x10000 + ((code & 0b1111111111) << 10) + (lo_code & 0b1111111111);
-                } else {
-                    // bad surrogate pair
-                    utf8_encode(code, ans);
-                    utf8_encode(lo_code, ans);
-                    return;
-                }
-            }
-            // else truncated surrogate pair
-        }
-        // encode utf-8
-        utf8_encode(code, ans);
+    // 4 hex digits validated by parse_hex()
+    static inline uint32_t decode_hex(const char *p) {
+        return (uint32_t(k_hex_numbers[(uint8_t)p[0]]) << 12) | (uint32_t(k_hex_numbers[(uint8_t)p[1]]) << 8)
+            | (uint32_t(k_hex_numbers[(uint8_t)p[2]]) << 4) | uint32_t(k_hex_numbers[(uint8_t)p[3]]);
     }
 
     static const char k_escape_chars[256] = {
@@ -202,221 +537,1180 @@ namespace j {
         0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
     };
 
-    static std::string parse_str(const char *&cur, const char *end) {
-        std::string ans;
+    static inline const char *skip_plain(const char *cur, const char *end) {
+#if defined(J_SSE2)
+        // NOTE: most strings are short, the first 16 bytes are checked inline
+        if (end - cur >= 16) {
+            uint32_t mask = special_mask_sse2(_mm_loadu_si128((const __m128i *)cur));
+            if (mask) {
+                return cur + __builtin_ctz(mask);
+            }
+            cur += 16;
+        }
+#endif
+        return g_skip_plain_run(cur, end);
+    }
+
+    // NOTE: stops at the first byte of the invalid UTF-8, which is a plain char
+    static inline const char *skip_plain_utf8(const char *cur, const char *end) {
+#if defined(J_SSE2)
+        // NOTE: most strings are short and ASCII, the first 16 bytes are checked inline
+        if (end - cur >= 16) {
+            __m128i v = _mm_loadu_si128((const __m128i *)cur);
+            uint32_t mask = special_mask_sse2(v);
+            if (!(_mm_movemask_epi8(v) & (mask ^ (mask - 1)))) {
+                if (mask) {
+                    return cur + __builtin_ctz(mask);
+                }
+                cur += 16;
+            }
+        }
+#endif
+        return g_skip_plain_utf8_run(cur, end);
+    }
+
+    // the raw text between the quotes, the escapes are validated but not decoded,
+    // escaped is set if there are escapes, the UTF-8 is validated with validate
+    static const char *scan_str(
+        bool validate, const char *&cur, const char *end, const char **raw, size_t *len, bool *escaped)
+    {
         if (!maybe_char(cur, end, '"')) {
-            throw _ParseError(cur, "expect string");
+            return "expect string";
         }
 
-        while (!maybe_char(cur, end, '"')) {
+        const char *begin = cur;
+        *escaped = false;
+        while (true) {
+            cur = validate ? skip_plain_utf8(cur, end) : skip_plain(cur, end);
             if (cur >= end) {
-                throw _ParseError(cur, "string not terminated");
+                return "string not terminated";
             }
-            if (maybe_char(cur, end, '\\')) {
-                if (cur >= end) {
-                    throw _ParseError(cur, "expect string escape");
-                }
-                char ch = *cur;
-                cur++;
-                // bfnrt "\/
-                if (0 != k_escape_chars[(uint8_t)ch]) {
-                    ans.push_back(k_escape_chars[(uint8_t)ch]);
-                } else if (ch == 'u') {
-                    parse_u(cur, end, ans);
-                } else {
-                    throw _ParseError(cur, "bad string escape");
+            if (*cur == '"') {
+                break;
+            }
+            if (*cur != '\\') {
+                return is_plain(*cur) ? "bad utf-8" : "unescaped control char";
+            }
+            cur++;
+            if (cur >= end) {
+                return "expect string escape";
+            }
+            char ch = *cur;
+            cur++;
+            // bfnrt "\/
+            if (0 != k_escape_chars[(uint8_t)ch]) {
+                // ok
+            } else if (ch == 'u') {
+                if (const char *err = expect_hex(cur, end)) {
+                    return err;
                 }
-            } else if ((uint8_t)*cur <= 0x1F) {
-                throw _ParseError(cur, "unescaped control char");
             } else {
-                ans.push_back(*cur);
-                cur++;
+                return "bad string escape";
             }
+            *escaped = true;
         }
-        // TODO: validate utf-8
-        return ans;
+        *raw = begin;
+        *len = cur - begin;
+        cur++;
+        return NULL;
     }
 
-    static void expect_more_digits(
-        const char *&cur, const char *end, std::string &ans, const char *err)
-    {
-        size_t i = ans.size();
+    size_t _unescape(const char *raw, size_t len, char *out) {
+        const char *cur = raw;
+        const char *end = raw + len;
+        char *p = out;
+        while (cur < end) {
+            const char *run = cur;
+            cur = (const char *)memchr(cur, '\\', end - cur);
+            if (!cur) {
+                cur = end;
+            }
+            memmove(p, run, cur - run);
+            p += cur - run;
+            if (cur >= end) {
+                break;
+            }
+
+            char ch = cur[1];
+            cur += 2;
+            if (ch != 'u') {
+                *p++ = k_escape_chars[(uint8_t)ch];
+                continue;
+            }
+            // decode code point
+            uint32_t code = decode_hex(cur);
+            cur += 4;
+            if (0xd800 <= code && code <= 0xdbff) {
+                // UTF-16 surrogate pair
+                if (cur + 2 <= end && cur[0] == '\\' && cur[1] == 'u') {
+                    uint32_t lo_code = decode_hex(cur + 2);
+                    cur += 6;
+                    if (0xdc00 <= lo_code && lo_code <= 0xdfff) {
+                        code = 0x10000 + ((code & 0b1111111111) << 10) + (lo_code & 0b1111111111);
+                    } else {
+                        // bad surrogate pair
+                        p = utf8_encode(code, p);
+                        code = lo_code;
+                    }
+                }
+                // else truncated surrogate pair
+            }
+            // encode utf-8
+            p = utf8_encode(code, p);
+        }
+        return p - out;
+    }
+
+#if defined(__GNUC__) && defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#   define J_SWAR 1
+#endif
+
+#if defined(J_SWAR)
+    // the number of the leading digits in the 8 chars of v
+    static inline size_t digit_count8(uint64_t v) {
+        // the high nibble of a digit is 3, and is still 3 after adding 6
+        // NOTE: the carry of a byte >= 0xfa only affects the bytes after it
+        uint64_t hi = v & 0xf0f0f0f0f0f0f0f0ull;
+        uint64_t hi6 = (v + 0x0606060606060606ull) & 0xf0f0f0f0f0f0f0f0ull;
+        uint64_t bad = (hi ^ 0x3030303030303030ull) | (hi6 ^ 0x3030303030303030ull);
+        return bad ? size_t(__builtin_ctzll(bad)) / 8 : 8;
+    }
+
+    // the value of the first n digits of v, 0 < n <= 8
+    static inline uint32_t digit_value8(uint64_t v, size_t n) {
+        // the digits are moved to the end, with '0's before them
+        v = (v << (64 - 8 * n)) | (0x3030303030303030ull >> (8 * n - 8) >> 8);
+        v -= 0x3030303030303030ull;
+        v = v * 10 + (v >> 8);
+        v = ((v & 0x000000ff000000ffull) * 0x000f424000000064ull
+            + ((v >> 16) & 0x000000ff000000ffull) * 0x0000271000000001ull) >> 32;
+        return uint32_t(v);
+    }
+
+    static const uint32_t k_pow10_8[] = {1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000};
+#endif
+
+    // the digits are consumed 8 at a time, the value wraps around after 19 digits
+    static inline const char *scan_digits(const char *cur, const char *end, uint64_t *pval) {
+        uint64_t val = *pval;
+#if defined(J_SWAR)
+        // NOTE: short runs are common, like 1 digit integers
+        while (end - cur >= 8 && ('0' <= *cur && *cur <= '9')) {
+            uint64_t v;
+            memcpy(&v, cur, 8);
+            size_t n = digit_count8(v);
+            if (n == 0) {
+                *pval = val;
+                return cur;
+            }
+            val = val * k_pow10_8[n] + digit_value8(v, n);
+            cur += n;
+            if (n < 8) {
+                *pval = val;
+                return cur;
+            }
+        }
+#endif
         while (cur < end && ('0' <= *cur && *cur <= '9')) {
-            ans.push_back(*cur);
+            val = val * 10 + (*cur - '0');
             cur++;
         }
-        if (ans.size() == i) {
-            throw _ParseError(cur, err);
+        *pval = val;
+        return cur;
+    }
+
+    static const char *expect_more_digits(const char *&cur, const char *end, const char *err) {
+        const char *begin = cur;
+        uint64_t val = 0;
+        cur = scan_digits(cur, end, &val);
+        if (cur == begin) {
+            return err;
         }
+        return NULL;
     }
 
-    static std::string verify_number(const char *&cur, const char *end) {
-        std::string ans;
+    // scan_number() results
+    enum {
+        N_TEXT = 0,     // keep the text
+        N_U64 = 1,
+        N_NEG = 2,      // negative integer, -val
+    };
+
+    // the number is the text consumed
+    // validate and classify to kind, the integer is stored in val
+    static const char *scan_number(const char *&cur, const char *end, uint64_t *pval, int *kind) {
+        *kind = N_TEXT;
         // sign
-        if (maybe_char(cur, end, '-')) {
-            ans.push_back(cur[-1]);
+        bool neg = maybe_char(cur, end, '-');
+        if (neg && maybe_tok(cur, end, "Infinity")) {
             // -inf
-            if (maybe_tok(cur, end, "Infinity")) {
-                ans.append("Infinity");
-                return ans;
-            }
+            return NULL;
         }
         // first digit of int
         if (cur >= end || !('0' <= *cur && *cur <= '9')) {
-            throw _ParseError(cur, "expected 0123456789");
+            return "expected 0123456789";
         }
-        ans.push_back(*cur);
+        const char *digits = cur;
+        uint64_t val = *cur - '0';
         cur++;
         // remain of int
-        if (ans[ans.size() - 1] != '0') {
-            while (cur < end && ('0' <= *cur && *cur <= '9')) {
-                ans.push_back(*cur);
-                cur++;
-            }
+        if (val != 0) {
+            cur = scan_digits(cur, end, &val);     // overflow is checked below
         }
+        size_t ndigits = cur - digits;
+        bool is_int = true;
         // frac
         if (maybe_char(cur, end, '.')) {
-            ans.push_back(cur[-1]);
-            expect_more_digits(cur, end, ans, "expected frac digits");
+            is_int = false;
+            if (const char *err = expect_more_digits(cur, end, "expected frac digits")) {
+                return err;
+            }
         }
         // exp
         if (maybe_char(cur, end, 'e') || maybe_char(cur, end, 'E')) {
-            ans.push_back(cur[-1]);
-            if (maybe_char(cur, end, '+') || maybe_char(cur, end, '-')) {
-                ans.push_back(cur[-1]);
+            is_int = false;
+            (void)(maybe_char(cur, end, '+') || maybe_char(cur, end, '-'));
+            if (const char *err = expect_more_digits(cur, end, "expected exp digits")) {
+                return err;
+            }
+        }
+
+        // the text of integers can be restored, except for -0
+        if (is_int && (ndigits < 20 || (ndigits == 20 && memcmp(digits, "18446744073709551615", 20) <= 0))) {
+            *pval = val;
+            if (!neg) {
+                *kind = N_U64;
+            } else if (val != 0 && val <= (uint64_t(1) << 63)) {
+                *kind = N_NEG;
             }
-            expect_more_digits(cur, end, ans, "expected exp digits");
         }
-        // ok
-        return ans;
+        return NULL;
     }
 
-    // TODO: parser options
-    static void parse_value(Parser &parser, const char *&cur, const char *end, _Node &node) {
-        parser.depth++;
-        if (parser.depth > parser.recursion_limit) {
-            throw _ParseError(cur, "recursion limit");
+    // integers are stored without the text
+    static const char *parse_number(_Arena &arena, const char *&cur, const char *end, _Node &node) {
+        const char *begin = cur;
+        uint64_t val = 0;
+        int kind = N_TEXT;
+        if (const char *err = scan_number(cur, end, &val, &kind)) {
+            return err;
+        }
+        if (kind == N_U64) {
+            _set_u64(arena, &node, val);
+        } else if (kind == N_NEG) {
+            _set_i64(arena, &node, int64_t(0 - val));
+        } else {
+            _set_num(arena, &node, begin, cur - begin);
         }
+        return NULL;
+    }
 
-        skip_to_token(parser, cur, end);
+    // TODO: parser options
+    // NOTE: not recursive, the depth is bounded by recursion_limit only
+    static const char *parse_value(Parser &parser, _Arena &arena, const char *&cur, const char *end, _Node &root) {
+        _Stack<_Node *> stack(arena.allocator);
+        _Node *node = &root;
+        bool found = false;
+
+    L_VALUE:
+        // the depth of node is the number of the open containers plus 1
+        if (stack.size >= parser.recursion_limit) {
+            return "recursion limit";
+        }
+        if (const char *err = skip_to_token(parser, cur, end)) {
+            return err;
+        }
         // map
         if (maybe_char(cur, end, '{')) {
-            while (!maybe_char_sp(parser, cur, end, '}')) {
-                // comma
-                if (!node.values.empty()) {
-                    expect_char(cur, end, ',', "comma");
+            _init(arena, node, T_MAP);
+            stack.push(node);
+            goto L_MAP;
+        }
+        // array
+        else if (maybe_char(cur, end, '[')) {
+            _init(arena, node, T_ARR);
+            stack.push(node);
+            goto L_ARR;
+        }
+        // true
+        else if (maybe_tok(cur, end, "true")) {
+            _node_init(node, T_TRUE);
+        }
+        // false
+        else if (maybe_tok(cur, end, "false")) {
+            _node_init(node, T_FALSE);
+        }
+        // null
+        else if (maybe_tok(cur, end, "null")) {
+            _node_init(node, T_NULL);
+        }
+        // string
+        else if (*cur == '"') {
+            const char *raw = NULL;
+            size_t len = 0;
+            bool escaped = false;
+            if (const char *err = scan_str(parser.validate_string, cur, end, &raw, &len, &escaped)) {
+                return err;
+            }
+            if (parser.borrow_input) {
+                _borrow_text(node, T_STR, raw, len);
+            } else {
+                _set_text(arena, node, T_STR, raw, len);
+            }
+            if (escaped) {
+                // decoded on the first access
+                node->flags |= F_ESCAPED;
+            }
+        }
+        // number
+        else if (('0' <= *cur && *cur <= '9') || *cur == '-') {
+            if (const char *err = parse_number(arena, cur, end, *node)) {
+                return err;
+            }
+        }
+        // nan
+        else if (maybe_tok(cur, end, "NaN")) {
+            _set_num(arena, node, "NaN", 3);
+        }
+        // +inf
+        else if (maybe_tok(cur, end, "Infinity")) {
+            _set_num(arena, node, "Infinity", 8);
+        }
+        // error
+        else {
+            return "not json";
+        }
+
+    L_NEXT:
+        // the value is done, back to its container
+        if (stack.size == 0) {
+            return NULL;
+        }
+        node = stack.top();
+        if (node->type == T_ARR) {
+            goto L_ARR;
+        }
+
+    L_MAP:
+        if (const char *err = maybe_char_sp(parser, cur, end, '}', &found)) {
+            return err;
+        }
+        // comma
+        if (!found && node->map->size > 0) {
+            if (!maybe_char(cur, end, ',')) {
+                return "expect comma";
+            }
+            if (parser.allow_extra_comma) {
+                if (const char *err = maybe_char_sp(parser, cur, end, '}', &found)) {
+                    return err;
                 }
-                if (parser.allow_extra_comma && !node.values.empty() && maybe_char_sp(parser, cur, end, '}')) {
-                    break;
+            }
+        }
+        if (found) {
+            stack.pop();
+            goto L_NEXT;
+        }
+        {
+            // key
+            if (const char *err = skip_to_token(parser, cur, end)) {
+                return err;
+            }
+            const char *key = NULL;
+            size_t len = 0;
+            bool escaped = false;
+            if (const char *err = scan_str(parser.validate_string, cur, end, &key, &len, &escaped)) {
+                return err;
+            }
+            if (escaped) {
+                // NOTE: decoded to the arena then copied as the key, escaped keys are rare
+                char *text = (char *)arena.alloc(len);
+                len = _unescape(key, len, text);
+                key = text;
+            }
+            // colon
+            if (const char *err = skip_to_token(parser, cur, end)) {
+                return err;
+            }
+            if (!maybe_char(cur, end, ':')) {
+                return "expect colon";
+            }
+            // value, the previous duplicated key is removed
+            node = _map_push(arena, node->map, key, len, !escaped && parser.borrow_input);
+            goto L_VALUE;
+        }
+
+    L_ARR:
+        if (const char *err = maybe_char_sp(parser, cur, end, ']', &found)) {
+            return err;
+        }
+        // comma
+        if (!found && node->arr->size > 0) {
+            if (!maybe_char(cur, end, ',')) {
+                return "expect comma";
+            }
+            if (parser.allow_extra_comma) {
+                if (const char *err = maybe_char_sp(parser, cur, end, ']', &found)) {
+                    return err;
                 }
-                // key
-                skip_to_token(parser, cur, end);
-                std::string key = parse_str(cur, end);
-                // colon
-                skip_to_token(parser, cur, end);
-                expect_char(cur, end, ':', "colon");
-                // value
-                node.values.push_back(_Node());
-                parse_value(parser, cur, end, node.values.back());
-                // link
-                std::map<std::string, size_t>::iterator it = node.keys.find(key);
-                if (it != node.keys.end()) {
-                    // remove previous key
-                    node.values[it->second] = _Node();
-                    it->second = node.values.size() - 1;
-                } else {
-                    node.keys[key] = node.values.size() - 1;
+            }
+        }
+        if (found) {
+            // arrays of scalars grow in place, return the unused capacity
+            _arr_shrink(arena, node->arr);
+            stack.pop();
+            goto L_NEXT;
+        }
+        // value
+        node = _arr_push(arena, node->arr);
+        goto L_VALUE;
+    }
+
+    static void *grow_buf(Allocator *allocator, void *buf, size_t *cap, size_t need, size_t elem) {
+        size_t ncap = *cap < 64 ? 64 : *cap;
+        while (ncap < need) {
+            ncap *= 2;
+        }
+        void *p = buf ? allocator->reallocate(buf, *cap * elem, ncap * elem) : allocator->allocate(ncap * elem);
+        if (!p) {
+            _bad_alloc();
+        }
+        *cap = ncap;
+        return p;
+    }
+
+    // the structural index
+    // stage 1 finds the positions of the tokens 64 bytes at a time,
+    // stage 2 builds the doc from them without looking at the whitespaces and the plain strings
+
+    // the positions of the tokens, ends with the length of the input
+    struct _Index {
+        Allocator *allocator;
+        uint32_t *pos;
+        size_t size;
+        size_t cap;
+
+        explicit _Index(Allocator *allocator)
+            : allocator(allocator), pos(NULL), size(0), cap(0)
+        {}
+        ~_Index() {
+            if (this->pos) {
+                this->allocator->deallocate(this->pos, this->cap * sizeof(uint32_t));
+            }
+        }
+
+    private:
+        _Index(const _Index &);
+        _Index &operator=(const _Index &);
+    };
+
+    // the carries between the blocks
+    struct _IndexState {
+        uint64_t escape;    // the last char escapes the next one
+        uint64_t in_str;    // all ones if the last block ends in a string
+        uint64_t sep;       // the last char is a separator
+        uint32_t last;      // the last 4 bytes, for the UTF-8 validation
+        bool bad_utf8;
+    };
+
+    // bit i is the parity of the quotes up to i
+    static inline uint64_t prefix_xor(uint64_t x) {
+        x ^= x << 1;
+        x ^= x << 2;
+        x ^= x << 4;
+        x ^= x << 8;
+        x ^= x << 16;
+        x ^= x << 32;
+        return x;
+    }
+
+    // the indexed tokens are:
+    // the structural chars and the quotes, the first char of other tokens,
+    // the backslashes and the control chars in strings, which are left to scan_str()
+    static inline void index_block(
+        _Index &index, _IndexState &st, size_t off,
+        uint64_t quote, uint64_t backslash, uint64_t space, uint64_t op, uint64_t ctrl)
+    {
+        // the escaped chars, a backslash is rare, one step for each
+        uint64_t escaped = st.escape;
+        uint64_t bs = backslash & ~escaped;
+        st.escape = 0;
+        while (bs) {
+            uint64_t bit = bs & (0 - bs);
+            escaped |= bit << 1;
+            st.escape = bit >> 63;
+            bs &= ~(bit | (bit << 1));
+        }
+
+        // the opening quote is in the string, the closing quote is not
+        quote &= ~escaped;
+        uint64_t in_str = prefix_xor(quote) ^ st.in_str;
+        st.in_str = uint64_t(int64_t(in_str) >> 63);
+        // other tokens start after a separator
+        uint64_t sep = space | op | quote;
+        uint64_t start = ((sep << 1) | st.sep) & ~sep & ~in_str;
+        st.sep = sep >> 63;
+        uint64_t bits = (op & ~in_str) | quote | start | ((backslash | ctrl) & in_str);
+
+        if (index.size + 64 + 1 > index.cap) {
+            index.pos = (uint32_t *)grow_buf(
+                index.allocator, index.pos, &index.cap, index.size + 64 + 1, sizeof(uint32_t));
+        }
+        while (bits) {
+            index.pos[index.size++] = uint32_t(off + __builtin_ctzll(bits));
+            bits &= bits - 1;
+        }
+    }
+
+    // the blocks of 64 bytes in [p, p + len), the positions are offset by base, the UTF-8 is validated with validate
+    typedef void (*_IndexFunc)(_Index &index, _IndexState &st, const char *p, size_t len, size_t base);
+
+#if defined(J_SSE2)
+    template <bool validate>
+    static void index_sse2(_Index &index, _IndexState &st, const char *p, size_t len, size_t base) {
+        __m128i prev = _mm_set_epi32(int(st.last), 0, 0, 0);
+        __m128i err = _mm_setzero_si128();
+        for (size_t off = 0; off + 64 <= len; off += 64) {
+            uint64_t quote = 0, backslash = 0, space = 0, op = 0, ctrl = 0;
+            for (uint32_t i = 0; i < 64; i += 16) {
+                __m128i v = _mm_loadu_si128((const __m128i *)(p + off + i));
+                // NOTE: [] are {} without the bit 0x20, no pshufb in SSE2
+                __m128i br = _mm_or_si128(v, _mm_set1_epi8(0x20));
+                __m128i o = _mm_or_si128(
+                    _mm_or_si128(_mm_cmpeq_epi8(br, _mm_set1_epi8('{')), _mm_cmpeq_epi8(br, _mm_set1_epi8('}'))),
+                    _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(':')), _mm_cmpeq_epi8(v, _mm_set1_epi8(','))));
+                __m128i c = _mm_cmpeq_epi8(_mm_min_epu8(v, _mm_set1_epi8(0x1F)), v);
+                quote |= uint64_t((uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('"')))) << i;
+                backslash |= uint64_t((uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('\\')))) << i;
+                space |= uint64_t(space_mask_sse2(v)) << i;
+                op |= uint64_t((uint32_t)_mm_movemask_epi8(o)) << i;
+                ctrl |= uint64_t((uint32_t)_mm_movemask_epi8(c)) << i;
+                // NOTE: the ASCII after the complete sequences has no errors
+                if (validate && _mm_movemask_epi8(_mm_or_si128(v, prev))) {
+                    err = _mm_or_si128(err, utf8_errors_sse2(v, prev));
                 }
-                node.values.back().key = key;
+                prev = v;
             }
-            node.type = T_MAP;
+            index_block(index, st, base + off, quote, backslash, space, op, ctrl);
         }
-        // array
-        else if (maybe_char(cur, end, '[')) {
-            while (!maybe_char_sp(parser, cur, end, ']')) {
-                // comma
-                if (!node.values.empty()) {
-                    expect_char(cur, end, ',', "comma");
+        st.last = uint32_t(_mm_cvtsi128_si32(_mm_srli_si128(prev, 12)));
+        st.bad_utf8 |= _mm_movemask_epi8(err) != 0;
+    }
+
+    template <bool validate>
+    __attribute__((target("avx2")))
+    static void index_avx2(_Index &index, _IndexState &st, const char *p, size_t len, size_t base) {
+        const __m256i space_table = _mm256_setr_epi8(
+            ' ', 100, 100, 100, 17, 100, 113, 2, 100, '\t', '\n', 112, 100, '\r', 100, 100,
+            ' ', 100, 100, 100, 17, 100, 113, 2, 100, '\t', '\n', 112, 100, '\r', 100, 100);
+        // NOTE: [] are {} without the bit 0x20
+        const __m256i op_table = _mm256_setr_epi8(
+            0, 0, 0, 0, 0, 0, 0, 0, 0, 0, ':', '{', ',', '}', 0, 0,
+            0, 0, 0, 0, 0, 0, 0, 0, 0, 0, ':', '{', ',', '}', 0, 0);
+        __m256i prev = _mm256_set_epi32(int(st.last), 0, 0, 0, 0, 0, 0, 0);
+        __m256i err = _mm256_setzero_si256();
+        for (size_t off = 0; off + 64 <= len; off += 64) {
+            uint64_t quote = 0, backslash = 0, space = 0, op = 0, ctrl = 0;
+            for (uint32_t i = 0; i < 64; i += 32) {
+                __m256i v = _mm256_loadu_si256((const __m256i *)(p + off + i));
+                // NOTE: looked up by the low 4 bits, the other entries never match
+                __m256i sp = _mm256_cmpeq_epi8(v, _mm256_shuffle_epi8(space_table, v));
+                // NOTE: 0x0c and 0x1a are taken as ops, they are invalid outside strings anyway
+                __m256i o = _mm256_cmpeq_epi8(_mm256_or_si256(v, _mm256_set1_epi8(0x20)), _mm256_shuffle_epi8(op_table, v));
+                __m256i c = _mm256_cmpeq_epi8(_mm256_min_epu8(v, _mm256_set1_epi8(0x1F)), v);
+                quote |= uint64_t((uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('"')))) << i;
+                backslash |= uint64_t((uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\')))) << i;
+                space |= uint64_t((uint32_t)_mm256_movemask_epi8(sp)) << i;
+                op |= uint64_t((uint32_t)_mm256_movemask_epi8(o)) << i;
+                ctrl |= uint64_t((uint32_t)_mm256_movemask_epi8(c)) << i;
+            }
+            if (validate) {
+                __m256i lo = _mm256_loadu_si256((const __m256i *)(p + off));
+                __m256i hi = _mm256_loadu_si256((const __m256i *)(p + off + 32));
+                // NOTE: the ASCII after the complete sequences has no errors
+                if (_mm256_movemask_epi8(_mm256_or_si256(_mm256_or_si256(lo, hi), prev))) {
+                    err = _mm256_or_si256(err, _mm256_or_si256(utf8_errors_avx2(lo, prev), utf8_errors_avx2(hi, lo)));
                 }
-                if (parser.allow_extra_comma && !node.values.empty() && maybe_char_sp(parser, cur, end, ']')) {
-                    break;
+                prev = hi;
+            }
+            index_block(index, st, base + off, quote, backslash, space, op, ctrl);
+        }
+        st.last = uint32_t(_mm256_extract_epi32(prev, 7));
+        st.bad_utf8 |= !_mm256_testz_si256(err, err);
+    }
+
+    static void index_resolve(_Index &index, _IndexState &st, const char *p, size_t len, size_t base);
+    static void index_utf8_resolve(_Index &index, _IndexState &st, const char *p, size_t len, size_t base);
+    static _IndexFunc g_index_blocks = index_resolve;
+    static _IndexFunc g_index_utf8_blocks = index_utf8_resolve;
+
+    static void index_simd_resolve() {
+        __builtin_cpu_init();
+        bool avx2 = __builtin_cpu_supports("avx2");
+        g_index_blocks = avx2 ? index_avx2<false> : index_sse2<false>;
+        g_index_utf8_blocks = avx2 ? index_avx2<true> : index_sse2<true>;
+    }
+
+    static void index_resolve(_Index &index, _IndexState &st, const char *p, size_t len, size_t base) {
+        index_simd_resolve();
+        g_index_blocks(index, st, p, len, base);
+    }
+
+    static void index_utf8_resolve(_Index &index, _IndexState &st, const char *p, size_t len, size_t base) {
+        index_simd_resolve();
+        g_index_utf8_blocks(index, st, p, len, base);
+    }
+#else
+    // the same checks as utf8_errors_sse2() for a byte, last is the 4 bytes before it
+    static inline bool utf8_error_scalar(uint32_t last, uint8_t ch) {
+        uint8_t prev1 = uint8_t(last >> 24);
+        uint8_t prev2 = uint8_t(last >> 16);
+        uint8_t prev3 = uint8_t(last >> 8);
+        bool cont = (ch & 0xC0) == 0x80;
+        bool must = prev1 >= 0xC0 || prev2 >= 0xE0 || prev3 >= 0xF0;
+        return cont != must || ch >= 0xF5 || (ch & 0xFE) == 0xC0
+            || (prev1 == 0xE0 && ch < 0xA0) || (prev1 == 0xED && ch >= 0xA0)
+            || (prev1 == 0xF0 && ch < 0x90) || (prev1 == 0xF4 && ch >= 0x90);
+    }
+
+    template <bool validate>
+    static void index_scalar(_Index &index, _IndexState &st, const char *p, size_t len, size_t base) {
+        for (size_t off = 0; off + 64 <= len; off += 64) {
+            uint64_t quote = 0, backslash = 0, space = 0, op = 0, ctrl = 0;
+            for (uint32_t i = 0; i < 64; ++i) {
+                uint64_t bit = uint64_t(1) << i;
+                char ch = p[off + i];
+                if (ch == '"') {
+                    quote |= bit;
+                } else if (ch == '\\') {
+                    backslash |= bit;
+                } else if (ch == '{' || ch == '}' || ch == '[' || ch == ']' || ch == ':' || ch == ',') {
+                    op |= bit;
+                }
+                if (is_space(ch)) {
+                    space |= bit;
+                }
+                if ((uint8_t)ch <= 0x1F) {
+                    ctrl |= bit;
                 }
-                // value
-                node.values.push_back(_Node());
-                parse_value(parser, cur, end, node.values.back());
+                if (validate && ((uint8_t)ch | st.last) & 0x80808080u) {
+                    st.bad_utf8 |= utf8_error_scalar(st.last, (uint8_t)ch);
+                }
+                st.last = (st.last >> 8) | (uint32_t((uint8_t)ch) << 24);
+            }
+            index_block(index, st, base + off, quote, backslash, space, op, ctrl);
+        }
+    }
+
+    static const _IndexFunc g_index_blocks = index_scalar<false>;
+    static const _IndexFunc g_index_utf8_blocks = index_scalar<true>;
+#endif
+
+    // stage 1, the positions end with the length of the input, the UTF-8 of the input is validated with validate
+    static bool index_input(_Index &index, const char *begin, const char *end, bool validate) {
+        size_t len = end - begin;
+        _IndexState st;
+        st.escape = 0;
+        st.in_str = 0;
+        st.sep = 1;     // the start of input
+        st.last = 0;
+        st.bad_utf8 = false;
+        size_t full = len & ~size_t(63);
+        (validate ? g_index_utf8_blocks : g_index_blocks)(index, st, begin, full, 0);
+        if (full < len) {
+            // padded with spaces
+            char tail[64];
+            memset(tail, ' ', sizeof(tail));
+            memcpy(tail, begin + full, len - full);
+            (validate ? g_index_utf8_blocks : g_index_blocks)(index, st, tail, sizeof(tail), full);
+        }
+        if (st.in_str) {
+            // string not terminated
+            return false;
+        }
+        // NOTE: the truncated sequence at the end is not checked, no valid input ends with a non-ASCII byte
+        if (st.bad_utf8) {
+            return false;
+        }
+        if (index.size + 1 > index.cap) {
+            index.pos = (uint32_t *)grow_buf(index.allocator, index.pos, &index.cap, index.size + 1, sizeof(uint32_t));
+        }
+        index.pos[index.size] = uint32_t(len);
+        return true;
+    }
+
+    // stage 2, the errors are not reported
+    struct _Tokens {
+        const char *begin;
+        const char *end;
+        const uint32_t *pos;
+
+        const char *peek() const {
+            return this->begin + *this->pos;
+        }
+        char peek_char() const {
+            const char *p = this->peek();
+            return p < this->end ? *p : '\0';
+        }
+        // NULL at the end
+        const char *next() {
+            const char *p = this->peek();
+            if (p >= this->end) {
+                return NULL;
+            }
+            this->pos++;
+            return p;
+        }
+        // a scalar ends with a whitespace or the next token
+        bool scalar_end(const char *cur) const {
+            return cur >= this->end || cur == this->peek() || is_space(*cur);
+        }
+    };
+
+    // the raw text of the string starts at the quote cur, escaped is set if there are escapes
+    // NOTE: the UTF-8 is validated by index_input()
+    static bool build_str(_Tokens &tokens, const char *cur, const char **raw, size_t *len, bool *escaped) {
+        const char *close = tokens.next();
+        if (!close) {
+            return false;
+        }
+        if (*close == '"') {
+            *raw = cur + 1;
+            *len = close - cur - 1;
+            *escaped = false;
+            return true;
+        }
+        // the backslashes and the control chars
+        if (scan_str(false, cur, tokens.end, raw, len, escaped)) {
+            return false;
+        }
+        while (tokens.peek() < cur) {
+            tokens.pos++;
+        }
+        return true;
+    }
+
+    // NOTE: not recursive like parse_value()
+    static bool build_value(Parser &parser, _Arena &arena, _Tokens &tokens, _Node &root) {
+        _Stack<_Node *> stack(arena.allocator);
+        _Node *node = &root;
+        const char *cur = NULL;
+
+    L_VALUE:
+        if (stack.size >= parser.recursion_limit) {
+            return false;
+        }
+        cur = tokens.next();
+        if (!cur) {
+            return false;
+        }
+        switch (*cur) {
+        case '{':
+            _init(arena, node, T_MAP);
+            if (tokens.peek_char() == '}') {
+                tokens.next();
+                break;
+            }
+            stack.push(node);
+            goto L_KEY;
+        case '[':
+            _init(arena, node, T_ARR);
+            if (tokens.peek_char() == ']') {
+                tokens.next();
+                _arr_shrink(arena, node->arr);
+                break;
+            }
+            stack.push(node);
+            node = _arr_push(arena, node->arr);
+            goto L_VALUE;
+        case '"': {
+            const char *raw = NULL;
+            size_t len = 0;
+            bool escaped = false;
+            if (!build_str(tokens, cur, &raw, &len, &escaped)) {
+                return false;
+            }
+            if (parser.borrow_input) {
+                _borrow_text(node, T_STR, raw, len);
+            } else {
+                _set_text(arena, node, T_STR, raw, len);
             }
-            node.type = T_ARR;
+            if (escaped) {
+                node->flags |= F_ESCAPED;
+            }
+            break;
+        }
+        case '-': case '0': case '1': case '2': case '3': case '4':
+        case '5': case '6': case '7': case '8': case '9':
+            if (parse_number(arena, cur, tokens.end, *node) || !tokens.scalar_end(cur)) {
+                return false;
+            }
+            break;
+        default:
+            if (maybe_tok(cur, tokens.end, "true")) {
+                _node_init(node, T_TRUE);
+            } else if (maybe_tok(cur, tokens.end, "false")) {
+                _node_init(node, T_FALSE);
+            } else if (maybe_tok(cur, tokens.end, "null")) {
+                _node_init(node, T_NULL);
+            } else if (maybe_tok(cur, tokens.end, "NaN")) {
+                _set_num(arena, node, "NaN", 3);
+            } else if (maybe_tok(cur, tokens.end, "Infinity")) {
+                _set_num(arena, node, "Infinity", 8);
+            } else {
+                return false;
+            }
+            if (!tokens.scalar_end(cur)) {
+                return false;
+            }
+        }
+
+    L_NEXT:
+        // the value is done, a comma or the end of its container follows
+        if (stack.size == 0) {
+            return true;
+        }
+        node = stack.top();
+        cur = tokens.next();
+        if (!cur) {
+            return false;
+        }
+        if (node->type == T_MAP) {
+            if (*cur == '}') {
+                stack.pop();
+                goto L_NEXT;
+            }
+            if (*cur != ',') {
+                return false;
+            }
+            if (parser.allow_extra_comma && tokens.peek_char() == '}') {
+                tokens.next();
+                stack.pop();
+                goto L_NEXT;
+            }
+        } else {
+            if (*cur == ']') {
+                _arr_shrink(arena, node->arr);
+                stack.pop();
+                goto L_NEXT;
+            }
+            if (*cur != ',') {
+                return false;
+            }
+            if (parser.allow_extra_comma && tokens.peek_char() == ']') {
+                tokens.next();
+                _arr_shrink(arena, node->arr);
+                stack.pop();
+                goto L_NEXT;
+            }
+            node = _arr_push(arena, node->arr);
+            goto L_VALUE;
+        }
+
+    L_KEY: {
+            // the map is on the top
+            cur = tokens.next();
+            if (!cur || *cur != '"') {
+                return false;
+            }
+            const char *key = NULL;
+            size_t len = 0;
+            bool escaped = false;
+            if (!build_str(tokens, cur, &key, &len, &escaped)) {
+                return false;
+            }
+            if (escaped) {
+                char *text = (char *)arena.alloc(len);
+                len = _unescape(key, len, text);
+                key = text;
+            }
+            // colon
+            cur = tokens.next();
+            if (!cur || *cur != ':') {
+                return false;
+            }
+            // value
+            node = _map_push(arena, stack.top()->map, key, len, !escaped && parser.borrow_input);
+            goto L_VALUE;
+        }
+    }
+
+    // returns false on errors, which are left to the byte-level parser
+    static bool parse_indexed(Parser &parser, Doc &doc, const char *begin, const char *end) {
+        _Index index(doc.allocator);
+        if (!index_input(index, begin, end, parser.validate_string)) {
+            return false;
+        }
+
+        doc.set_root();
+        _Tokens tokens;
+        tokens.begin = begin;
+        tokens.end = end;
+        tokens.pos = index.pos;
+        if (!build_value(parser, *doc.arena, tokens, *doc.ref)) {
+            return false;
+        }
+        // trailing garbage
+        return tokens.peek() >= end;
+    }
+
+    // drop the tree, the memory is reused if the arena is not shared
+    static void _reuse(Doc &doc) {
+        if (doc.arena && doc.arena->refs == 1) {
+            _unlink_all(*doc.arena);
+            _discard(*doc.arena, doc.ref);
+            doc.arena->reset();
+            doc.ref = NULL;
+        } else {
+            doc.clear();
+        }
+    }
+
+    bool Parser::parse(const char *begin, const char *end, Doc &doc) {
+        this->err = "";
+        this->errpos = 0;
+        _reuse(doc);
+
+        // NOTE: the comments are not indexed, the positions are 32 bits
+        bool indexed = this->structural_index && !this->allow_comment && size_t(end - begin) < 0xffffffffu;
+        if (indexed) {
+            if (parse_indexed(*this, doc, begin, end)) {
+                return true;
+            }
+            // the error is reported by the byte-level parser
+            _reuse(doc);
+        }
+
+        doc.set_root();
+        const char *cur = begin;
+        const char *err = parse_value(*this, *doc.arena, cur, end, *doc.ref);
+        if (!err) {
+            // trailing garbage
+            err = skip_to_eof(*this, cur, end);
+        }
+        if (err) {
+            this->err = err;
+            this->errpos = cur - begin;
+            _reuse(doc);
+            return false;
+        }
+
+        // the structural index must accept the same inputs
+        assert(!indexed);
+        return true;
+    }
+
+    bool Parser::parse(const char *begin, Doc &doc) {
+        return this->parse(begin, begin + strlen(begin), doc);
+    }
+    bool Parser::parse(const std::string &input, Doc &doc) {
+        return this->parse(input.data(), input.data() + input.size(), doc);
+    }
+
+    // FrozenDoc
+    static inline size_t tape_push(FrozenDoc &doc, uint64_t e) {
+        if (doc.size == doc.cap) {
+            doc.tape = (uint64_t *)grow_buf(doc.allocator, doc.tape, &doc.cap, doc.size + 1, sizeof(uint64_t));
+        }
+        doc.tape[doc.size] = e;
+        return doc.size++;
+    }
+
+    // the text follows its length, returns the offset
+    static uint64_t strs_push(FrozenDoc &doc, const char *data, size_t len) {
+        assert(len <= 0xffffffffu);
+        size_t need = doc.strs_size + sizeof(uint32_t) + len + 1;
+        if (need > doc.strs_cap) {
+            doc.strs = (char *)grow_buf(doc.allocator, doc.strs, &doc.strs_cap, need, 1);
+        }
+        size_t off = doc.strs_size;
+        uint32_t len32 = (uint32_t)len;
+        memcpy(doc.strs + off, &len32, sizeof(uint32_t));
+        memcpy(doc.strs + off + sizeof(uint32_t), data, len);
+        doc.strs[off + sizeof(uint32_t) + len] = '\0';
+        doc.strs_size = need;
+        return off;
+    }
+
+    static void push_text(FrozenDoc &doc, uint8_t type, const char *data, size_t len) {
+        uint64_t off = strs_push(doc, data, len);
+        tape_push(doc, _tape_entry(type, 0, off));
+        if (type == T_NUM) {
+            double d = 0;
+            (void)_strtod(data, data + len, &d);
+            uint64_t bits;
+            memcpy(&bits, &d, sizeof(double));
+            tape_push(doc, bits);
+        }
+    }
+
+    static void push_str(FrozenDoc &doc, const char *raw, size_t len, bool escaped) {
+        uint64_t off = strs_push(doc, raw, len);
+        if (escaped) {
+            // decoded in place, not longer than the raw text
+            char *text = doc.strs + off + sizeof(uint32_t);
+            uint32_t len32 = (uint32_t)_unescape(text, len, text);
+            memcpy(doc.strs + off, &len32, sizeof(uint32_t));
+            text[len32] = '\0';
+            doc.strs_size = off + sizeof(uint32_t) + len32 + 1;
+        }
+        tape_push(doc, _tape_entry(T_STR, 0, off));
+    }
+
+    // NOTE: not recursive, the open containers are their tape offsets, the count is kept on the tape
+    static const char *parse_frozen(Parser &parser, FrozenDoc &doc, const char *&cur, const char *end) {
+        _Stack<size_t> stack(doc.allocator);
+        bool found = false;
+
+    L_VALUE:
+        if (stack.size >= parser.recursion_limit) {
+            return "recursion limit";
+        }
+        if (const char *err = skip_to_token(parser, cur, end)) {
+            return err;
+        }
+        // map or array, the entries are filled at the end
+        if (maybe_char(cur, end, '{')) {
+            stack.push(tape_push(doc, _tape_entry(T_MAP, 0, 0)));
+            tape_push(doc, 0);
+            goto L_CONTAINER;
+        } else if (maybe_char(cur, end, '[')) {
+            stack.push(tape_push(doc, _tape_entry(T_ARR, 0, 0)));
+            tape_push(doc, 0);
+            goto L_CONTAINER;
         }
         // true
         else if (maybe_tok(cur, end, "true")) {
-            node.type = T_TRUE;
+            tape_push(doc, _tape_entry(T_TRUE, 0, 0));
         }
         // false
         else if (maybe_tok(cur, end, "false")) {
-            node.type = T_FALSE;
+            tape_push(doc, _tape_entry(T_FALSE, 0, 0));
         }
         // null
         else if (maybe_tok(cur, end, "null")) {
-            node.type = T_NULL;
+            tape_push(doc, _tape_entry(T_NULL, 0, 0));
         }
         // string
         else if (*cur == '"') {
-            node.val = parse_str(cur, end);
-            node.type = T_STR;
+            const char *raw = NULL;
+            size_t len = 0;
+            bool escaped = false;
+            if (const char *err = scan_str(parser.validate_string, cur, end, &raw, &len, &escaped)) {
+                return err;
+            }
+            push_str(doc, raw, len, escaped);
         }
         // number
         else if (('0' <= *cur && *cur <= '9') || *cur == '-') {
-            node.val = verify_number(cur, end);
-            node.type = T_NUM;
+            const char *begin = cur;
+            uint64_t val = 0;
+            int kind = N_TEXT;
+            if (const char *err = scan_number(cur, end, &val, &kind)) {
+                return err;
+            }
+            if (kind == N_TEXT) {
+                push_text(doc, T_NUM, begin, cur - begin);
+            } else {
+                tape_push(doc, _tape_entry(T_NUM, kind == N_NEG ? (F_INT | F_NEG) : F_INT, 0));
+                tape_push(doc, kind == N_NEG ? 0 - val : val);
+            }
         }
         // nan
         else if (maybe_tok(cur, end, "NaN")) {
-            node.type = T_NUM;
-            node.val = "NaN";
+            push_text(doc, T_NUM, "NaN", 3);
         }
         // +inf
         else if (maybe_tok(cur, end, "Infinity")) {
-            node.type = T_NUM;
-            node.val = "Infinity";
+            push_text(doc, T_NUM, "Infinity", 8);
         }
         // error
         else {
-            throw _ParseError(cur, "not json");
+            return "not json";
         }
 
-        parser.depth--;
+    L_NEXT:
+        // the value is done, back to its container
+        if (stack.size == 0) {
+            return NULL;
+        }
+
+    L_CONTAINER: {
+            size_t start = stack.top();
+            bool is_map = _tape_type(doc.tape[start]) == T_MAP;
+            char close = is_map ? '}' : ']';
+            if (const char *err = maybe_char_sp(parser, cur, end, close, &found)) {
+                return err;
+            }
+            // comma
+            if (!found && doc.tape[start + 1] > 0) {
+                if (!maybe_char(cur, end, ',')) {
+                    return "expect comma";
+                }
+                if (parser.allow_extra_comma) {
+                    if (const char *err = maybe_char_sp(parser, cur, end, close, &found)) {
+                        return err;
+                    }
+                }
+            }
+            if (found) {
+                doc.tape[start] = _tape_entry(is_map ? T_MAP : T_ARR, 0, doc.size);
+                stack.pop();
+                goto L_NEXT;
+            }
+            if (is_map) {
+                // key
+                if (const char *err = skip_to_token(parser, cur, end)) {
+                    return err;
+                }
+                const char *key = NULL;
+                size_t len = 0;
+                bool escaped = false;
+                if (const char *err = scan_str(parser.validate_string, cur, end, &key, &len, &escaped)) {
+                    return err;
+                }
+                push_str(doc, key, len, escaped);
+                // colon
+                if (const char *err = skip_to_token(parser, cur, end)) {
+                    return err;
+                }
+                if (!maybe_char(cur, end, ':')) {
+                    return "expect colon";
+                }
+            }
+            // value
+            doc.tape[start + 1]++;
+            goto L_VALUE;
+        }
     }
 
-    bool Parser::parse(const char *begin, const char *end, Doc &doc) {
-        this->depth = 0;
-        this->err.clear();
+    bool Parser::parse(const char *begin, const char *end, FrozenDoc &doc) {
+        this->err = "";
         this->errpos = 0;
-        if (doc.ref) {
-            delete doc.ref;
-            doc.ref = NULL;
-        }
+        // reuse the buffers
+        doc.size = 0;
+        doc.strs_size = 0;
 
-        try {
-            doc.ref = new _Node();
-            const char *cur = begin;
-            parse_value(*this, cur, end, *doc.ref);
+        const char *cur = begin;
+        const char *err = parse_frozen(*this, doc, cur, end);
+        if (!err) {
             // trailing garbage
-            skip_to_eof(*this, cur, end);
-        } catch (_ParseError &exc) {
-            this->err.swap(exc.err);
-            this->errpos = exc.pos - begin;
-            delete doc.ref;
-            doc.ref = NULL;
+            err = skip_to_eof(*this, cur, end);
+        }
+        if (err) {
+            this->err = err;
+            this->errpos = cur - begin;
+            doc.size = 0;
+            doc.strs_size = 0;
             return false;
         }
 
         return true;
     }
 
-    bool Parser::parse(const char *begin, Doc &doc) {
+    bool Parser::parse(const char *begin, FrozenDoc &doc) {
         return this->parse(begin, begin + strlen(begin), doc);
     }
-    bool Parser::parse(const std::string &input, Doc &doc) {
+    bool Parser::parse(const std::string &input, FrozenDoc &doc) {
         return this->parse(input.data(), input.data() + input.size(), doc);
     }
 
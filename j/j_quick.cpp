@@ -7,11 +7,13 @@
 #include <stdlib.h>
 // proj
 #include "j_quick.h"
+#include "j_def.h"
 
 
 namespace j {
 
-    static int32_t read_file(const char *filename, uint8_t **buf, size_t *sz) {
+    // the content is allocated from arena
+    static int32_t read_file(const char *filename, _Arena &arena, uint8_t **buf, size_t *sz) {
         assert(*buf == NULL);
 
         int fd = ::open(filename, O_RDONLY);
@@ -28,10 +30,7 @@ namespace j {
         }
 
         if (fs.st_size > 0) {
-            *buf = (uint8_t *)malloc(fs.st_size + 1);           // +1 for eof detection
-            if (!*buf) {
-                goto L_RETURN;
-            }
+            *buf = (uint8_t *)arena.alloc(fs.st_size + 1);      // +1 for eof detection
 
             size_t got = 0;
             while (true) {
@@ -59,31 +58,41 @@ namespace j {
 
     L_RETURN:
         ::close(fd);
-        if (err) {
-            ::free(*buf);
-        }
         return err;
     }
 
     bool parse_file(const char *filename, Doc &doc) {
         struct destructor {
-            uint8_t *buf;
+            _Arena *input;
 
+            destructor() : input(NULL) {}
             ~destructor() {
-                free(buf);
+                if (input) {
+                    _arena_release(input);
+                }
             }
         } local;
-        local.buf = NULL;
+        local.input = _arena_new(doc.allocator);
 
+        uint8_t *buf = NULL;
         size_t sz = 0;
-        if (0 != read_file(filename, &local.buf, &sz)) {
+        if (0 != read_file(filename, *local.input, &buf, &sz)) {
             return false;
         }
 
         if (sz == 0) {
             return false;
         }
-        return Parser().parse((const char *)local.buf, (const char *)(local.buf + sz), doc);
+        Parser parser;
+        parser.borrow_input = true;
+        if (!parser.parse((const char *)buf, (const char *)(buf + sz), doc)) {
+            return false;
+        }
+        // the parsed arena is not shared, no cycles
+        bool ok = _arena_depend(*doc.arena, local.input);
+        assert(ok);
+        (void)ok;
+        return true;
     }
 
 }   // ::j
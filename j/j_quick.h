@@ -10,6 +10,7 @@ namespace j {
     // API
 
     inline bool parse(const std::string &input, Doc &doc);
+    // the strings are borrowed from the content, which is kept by doc, see Parser::borrow_input
     bool parse_file(const char *filename, Doc &doc);
 
     inline std::string dumps(const Doc &doc);
@@ -589,7 +590,7 @@ namespace j {
     }
     template <>
     inline void __set_scalar(NodeResult h, const float &val) {
-        h.set_double(val);
+        h.set_float(val);
     }
     template <>
     inline void __set_scalar(NodeResult h, const double &val) {
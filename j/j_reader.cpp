@@ -1,5 +1,6 @@
 // system
 #include <stdlib.h>
+#include <string.h>
 // proj
 #include "j.h"
 #include "j_def.h"
@@ -136,17 +137,42 @@ namespace j {
     }
 
     static bool _parse_u64(const _Node *ref, uint64_t *out) {
-        if (!ref || ref->type != T_NUM || ref->val[0] == '-') {
+        if (!ref || ref->type != T_NUM) {
             return false;
         }
-        return __parse_decimal(ref->val.c_str(), out);
+        const _Node *num = _unbox(ref);
+        if (num->flags & F_INT) {
+            if (num->flags & F_NEG) {
+                return false;
+            }
+            if (out) {
+                *out = num->u64;
+            }
+            return true;
+        }
+        // integers in float form
+        if (num->str[0] == '-') {
+            return false;
+        }
+        return __parse_decimal(num->str, out);
     }
 
     static bool _parse_i64(const _Node *ref, int64_t *out) {
         if (!ref || ref->type != T_NUM) {
             return false;
         }
-        const char *input = ref->val.c_str();
+        const _Node *num = _unbox(ref);
+        if (num->flags & F_INT) {
+            if (!(num->flags & F_NEG) && num->u64 > 0x7fffffffffffffffULL) {   // INT64_MAX
+                return false;
+            }
+            if (out) {
+                *out = num->i64;
+            }
+            return true;
+        }
+        // integers in float form
+        const char *input = num->str;
         bool neg = false;
         if (input[0] == '-') {
             neg = true;
@@ -168,22 +194,12 @@ namespace j {
         return true;
     }
 
-    bool __parse_double(const std::string &val, double *out) {
+    static bool _parse_double(const char *val, size_t len, double *out) {
         double d = 0;
-        if (val == "NaN") {
-            d = 0.0 / 0.0;
-        } else if (val == "Infinity") {
-            d = 1.0 / 0.0;
-        } else if (val == "-Infinity") {
-            d = -1.0 / 0.0;
-        } else {
-            char *end = NULL;
-            d = strtod(val.data(), &end);
-            // overflow or underflow is ok
-            if (end != val.data() + val.size()) {
-                // bad format?
-                return false;
-            }
+        // overflow or underflow is ok
+        if (_strtod(val, val + len, &d) != val + len) {
+            // bad format?
+            return false;
         }
         if (out) {
             *out = d;
@@ -191,52 +207,81 @@ namespace j {
         return true;
     }
 
+    bool __parse_double(const std::string &val, double *out) {
+        return _parse_double(val.c_str(), val.size(), out);
+    }
+
     static bool _parse_double(const _Node *ref, double *out) {
         if (!ref || ref->type != T_NUM) {
             return false;
         }
-        return __parse_double(ref->val, out);
+        if (out) {
+            const _Node *num = _unbox(ref);
+            if (!(num->flags & F_INT)) {
+                *out = _num_double(num);
+            } else if (num->flags & F_NEG) {
+                *out = double(num->i64);
+            } else {
+                *out = double(num->u64);
+            }
+        }
+        return true;
     }
 
-    static _Node *_point(_Node *ref, const char *pointer) {
-        while (ref && pointer[0]) {
-            if (pointer[0] != '/') {
-                // not a pointer
-                return NULL;
-            }
-            pointer++;
-            // decode key
-            std::string key;
-            while (pointer[0] && pointer[0] != '/') {
-                if (pointer[0] == '~') {
-                    if (pointer[1] == '0') {
-                        key.push_back('~');
-                    } else if (pointer[1] == '1') {
-                        key.push_back('/');
-                    } else {
-                        // bad pointer escape
-                        return NULL;
-                    }
-                    pointer += 2;
+    // decode the next key of the pointer
+    static bool _pointer_key(const char *&pointer, std::string &key) {
+        if (pointer[0] != '/') {
+            // not a pointer
+            return false;
+        }
+        pointer++;
+        key.clear();
+        while (pointer[0] && pointer[0] != '/') {
+            if (pointer[0] == '~') {
+                if (pointer[1] == '0') {
+                    key.push_back('~');
+                } else if (pointer[1] == '1') {
+                    key.push_back('/');
                 } else {
-                    key.push_back(pointer[0]);
-                    pointer++;
+                    // bad pointer escape
+                    return false;
                 }
+                pointer += 2;
+            } else {
+                key.push_back(pointer[0]);
+                pointer++;
+            }
+        }
+        return true;
+    }
+
+    // arena is updated to the owner of the result
+    static _Node *_point(_Node *ref, _Arena **arena, const char *pointer) {
+        std::string key;
+        while (ref && pointer[0]) {
+            if (!_pointer_key(pointer, key)) {
+                return NULL;
             }
             // access key
             if (ref->type == T_MAP) {
                 ConstMapResult t;
                 t.ref = ref;
-                ref = t.key(key.c_str()).ref;       // lookup only
+                t.arena = *arena;
+                ConstNodeResult v = t.key(key.c_str());     // lookup only
+                ref = v.ref;
+                *arena = v.arena;
             } else if (ref->type == T_ARR) {
-                ArrayResult t;
+                ConstArrayResult t;
                 t.ref = ref;
+                t.arena = *arena;
                 uint64_t idx = 0;
                 if (!_parse_digits(&idx, key.data(), key.data() + key.size())) {    // NOTE: accepts non-std index
                     // bad array index
                     return NULL;
                 }
-                ref = t.at(idx).ref;
+                ConstNodeResult v = t.at(idx);
+                ref = v.ref;
+                *arena = v.arena;
             } else {
                 // bad node type
                 return NULL;
@@ -249,6 +294,91 @@ namespace j {
         return ref;
     }
 
+    static inline size_t _align8(size_t n) {
+        return (n + 7) & ~size_t(7);
+    }
+
+    struct _StatsItem {
+        const _Node *node;
+        size_t depth;
+    };
+
+    static void _stats(const _Node *node, size_t depth, MemoryStats &st, _Stack<_StatsItem> &stack);
+
+    // a scalar is counted at once, a container is pushed to be visited
+    static inline void _stats_child(const _Node *node, size_t depth, MemoryStats &st, _Stack<_StatsItem> &stack) {
+        if (node->type == T_ARR || node->type == T_MAP) {
+            _StatsItem item = { node, depth };
+            stack.push(item);
+        } else {
+            _stats(node, depth, st, stack);
+        }
+    }
+
+    // the node itself is counted by its container
+    static void _stats(const _Node *node, size_t depth, MemoryStats &st, _Stack<_StatsItem> &stack) {
+        if (depth > st.max_depth) {
+            st.max_depth = depth;
+        }
+        if (node->flags & F_BOXED) {
+            st.bytes += _align8(sizeof(_Box)) + _heap_bytes(node->box->str);
+        }
+        const _Node *orig = _unbox(node);
+        if (node->type == T_NULL) {
+            st.nulls++;
+        } else if (node->type == T_TRUE || node->type == T_FALSE) {
+            st.bools++;
+        } else if (node->type == T_NUM) {
+            st.numbers++;
+            if (!(orig->flags & F_INT)) {
+                st.bytes += _align8(sizeof(double) + orig->len + 1);
+            }
+        } else if (node->type == T_STR) {
+            st.strings++;
+            if (!(orig->flags & F_BORROWED)) {
+                st.bytes += _align8(orig->len + 1);
+            }
+            st.string_bytes += orig->len;
+        } else if (node->type == T_ARR) {
+            const _Array *arr = node->arr;
+            st.arrays++;
+            st.bytes += _align8(sizeof(_Array)) + sizeof(_Node) * arr->cap;
+            st.slack += sizeof(_Node) * (arr->cap - arr->size);
+            for (uint32_t i = 0; i < arr->size; ++i) {
+                if (arr->values[i].type != T_DEL) {
+                    _stats_child(&arr->values[i], depth + 1, st, stack);
+                }
+            }
+        } else if (node->type == T_MAP) {
+            const _Map *map = node->map;
+            st.maps++;
+            st.bytes += _align8(sizeof(_Map)) + sizeof(_Node) * map->cap;
+            st.slack += sizeof(_Node) * (map->cap - map->size);
+            st.tombstones += map->size - map->count;
+            if (!map->shape) {
+                // own keys
+                st.bytes += sizeof(_Node) * map->cap;
+                st.slack += sizeof(_Node) * (map->cap - map->size);
+                if (map->table) {
+                    st.bytes += sizeof(_HashEntry) * (map->mask + 1);
+                }
+            }
+            for (uint32_t i = 0; i < map->size; ++i) {
+                const _Node *name = &map->names[i];
+                if (name->type == T_DEL) {
+                    continue;
+                }
+                st.string_bytes += name->len;
+                if (!map->shape && !(name->flags & F_BORROWED)) {
+                    st.bytes += _align8(name->len + 1);
+                }
+                if (map->values[i].type != T_DEL) {
+                    _stats_child(&map->values[i], depth + 1, st, stack);
+                }
+            }
+        }
+    }
+
     // NodeResult
     bool _NodeReader::is_null() const {
         return ref && ref->type == T_NULL;
@@ -271,7 +401,7 @@ namespace j {
     }
     const std::string &_NodeReader::get_number(const std::string &def) const {
         if (ref && ref->type == T_NUM) {
-            return ref->val;
+            return arena->box(ref);
         } else {
             return def;
         }
@@ -301,7 +431,7 @@ namespace j {
         return ref && ref->type == T_STR;
     }
     const std::string &_NodeReader::get_str(const std::string &def) const {
-        return (ref && ref->type == T_STR) ? ref->val : def;
+        return (ref && ref->type == T_STR) ? arena->box(ref) : def;
     }
     bool _NodeReader::is_arr() const {
         return this->get_arr().ok();
@@ -310,6 +440,7 @@ namespace j {
         ConstArrayResult r;
         if (ref && ref->type == T_ARR) {
             r.ref = (_Node *)ref;
+            r.arena = arena;
         }
         return r;
     }
@@ -320,32 +451,54 @@ namespace j {
         ConstMapResult r;
         if (ref && ref->type == T_MAP) {
             r.ref = (_Node *)ref;
+            r.arena = arena;
         }
         return r;
     }
+    MemoryStats _NodeReader::memory_stats() const {
+        MemoryStats st;
+        if (ref && ref->type != T_DEL) {
+            st.bytes += sizeof(_Node);
+            // NOTE: not recursive, the trees may be deep
+            _Stack<_StatsItem> stack(arena ? arena->allocator : malloc_allocator());
+            _stats(ref, 1, st, stack);
+            while (stack.size > 0) {
+                _StatsItem item = stack.top();
+                stack.pop();
+                _stats(item.node, item.depth, st, stack);
+            }
+        }
+        return st;
+    }
     _MovingNode _NodeReader::clone() const {
-        return _MovingNode(new _Node(*ref));
+        _Arena *dst = _arena_new(arena ? arena->allocator : malloc_allocator());
+        _Node *root = dst->new_node();
+        _share(*dst, root, ref, arena);
+        return _MovingNode(root, dst);
     }
 
     // ArrayResult
     size_t _ArrayReader::size() const {
-        return ref ? ref->values.size() : 0;
+        return ref ? ref->arr->size : 0;
     }
     ConstNodeResult _ArrayReader::at(size_t i) const {
         ConstNodeResult r;
-        if (ref && i < ref->values.size()) {
-            r.ref = &ref->values[i];
+        if (ref && i < ref->arr->size) {
+            r.ref = &ref->arr->values[i];
+            r.arena = ref->arr->arena->owner();
         }
         return r;
     }
 
     // MapResult
     size_t _MapReader::size() const {
-        return ref ? ref->keys.size() : 0;
+        return ref ? ref->map->count : 0;
     }
     ConstNodeResult _MapReader::point(const char *pointer) const {
         ConstNodeResult r;
-        r.ref = _point(ref, pointer);
+        _Arena *owner = arena;
+        r.ref = _point(ref, &owner, pointer);
+        r.arena = r.ref ? owner : NULL;
         return r;
     }
     ConstNodeResult _MapReader::key(const char *key) const {
@@ -353,18 +506,17 @@ namespace j {
         if (!ref) {
             return r;
         }
-        std::map<std::string, size_t>::iterator it = ref->keys.find(key);
-        if (it != ref->keys.end()) {
-            r.ref = &ref->values[it->second];
-        }
+        r.ref = _map_find(ref->map, key, strlen(key));
         if (r.ref && r.ref->type == T_DEL) {
             r.ref = NULL;
         }
+        r.arena = r.ref ? ref->map->arena->owner() : NULL;
         return r;
     }
     ConstMapIterator _MapReader::iter() const {
         ConstMapIterator r;
         r.ref = ref;
+        r.arena = arena;
         return r;
     }
 
@@ -375,26 +527,28 @@ namespace j {
         if (!ref) {
             return false;
         }
+        const _Map *map = ref->map;
         // skip deleted nodes
-        while (i + 1 < ref->values.size() && ref->values[i + 1].type == T_DEL) {
+        while (i + 1 < map->size && map->values[i + 1].type == T_DEL) {
             i++;
         }
         // advance cursor, note i is initialized to ~0
-        if (i + 1 <= ref->values.size()) {
+        if (i + 1 <= map->size) {
             i++;
         }
-        return i < ref->values.size();
+        return i < map->size;
     }
     const std::string &ConstMapIterator::key() const {
-        if (!ref || i >= ref->values.size() || ref->values[i].type == T_DEL) {
+        if (!ref || i >= ref->map->size || ref->map->values[i].type == T_DEL) {
             return g_empty_str;
         }
-        return ref->values[i].key;
+        return ref->map->arena->owner()->box(&ref->map->names[i]);
     }
     ConstNodeResult ConstMapIterator::value() const {
         ConstNodeResult r;
-        if (ref && i < ref->values.size() && ref->values[i].type != T_DEL) {
-            r.ref = &ref->values[i];
+        if (ref && i < ref->map->size && ref->map->values[i].type != T_DEL) {
+            r.ref = &ref->map->values[i];
+            r.arena = ref->map->arena->owner();
         }
         return r;
     }
@@ -403,16 +557,316 @@ namespace j {
     Doc::Doc(const _MovingNode &move) {
         this->clear();
         this->ref = move.ref;
+        this->arena = move.arena;
+        this->allocator = move.arena ? move.arena->allocator : malloc_allocator();
         move.ref = NULL;
+        move.arena = NULL;
     }
     Doc::~Doc() {
-        delete this->ref;
-        this->ref = NULL;
+        this->clear();
+    }
+    size_t Doc::memory_usage() const {
+        return this->arena ? this->arena->bytes : 0;
     }
     ConstNodeResult Doc::get_root() const {
         ConstNodeResult r;
         if (ref && ref->type != T_DEL) {
             r.ref = ref;
+            r.arena = arena;
+        }
+        return r;
+    }
+
+    // FrozenDoc
+    FrozenDoc::~FrozenDoc() {
+        this->clear();
+    }
+    FrozenDoc &FrozenDoc::clear() {
+        if (this->tape) {
+            this->allocator->deallocate(this->tape, this->cap * sizeof(uint64_t));
+        }
+        if (this->strs) {
+            this->allocator->deallocate(this->strs, this->strs_cap);
+        }
+        this->tape = NULL;
+        this->strs = NULL;
+        this->size = this->cap = 0;
+        this->strs_size = this->strs_cap = 0;
+        return *this;
+    }
+    size_t FrozenDoc::memory_usage() const {
+        return this->cap * sizeof(uint64_t) + this->strs_cap;
+    }
+    FrozenNodeResult FrozenDoc::get_root() const {
+        FrozenNodeResult r;
+        if (this->size > 0) {
+            r.doc = this;
+        }
+        return r;
+    }
+
+    static inline uint64_t _frozen_entry(const FrozenDoc *doc, size_t i) {
+        return doc ? doc->tape[i] : 0;  // T_DEL
+    }
+
+    // the number as a _Node for the converters of Doc
+    static const _Node *_frozen_num(const FrozenDoc *doc, size_t i, _Node *node) {
+        uint64_t e = _frozen_entry(doc, i);
+        if (_tape_type(e) != T_NUM) {
+            return NULL;
+        }
+        _node_init(node, T_NUM);
+        node->flags = _tape_flags(e);
+        if (node->flags & F_INT) {
+            node->u64 = doc->tape[i + 1];
+        } else {
+            node->str = _tape_text(doc->strs, e, &node->len);
+        }
+        return node;
+    }
+
+    // FrozenNodeResult
+    bool FrozenNodeResult::is_null() const {
+        return _tape_type(_frozen_entry(doc, i)) == T_NULL;
+    }
+    bool FrozenNodeResult::is_bool() const {
+        uint8_t type = _tape_type(_frozen_entry(doc, i));
+        return type == T_TRUE || type == T_FALSE;
+    }
+    bool FrozenNodeResult::get_bool(bool def) const {
+        switch (_tape_type(_frozen_entry(doc, i))) {
+        case T_TRUE: return true;
+        case T_FALSE: return false;
+        default: return def;
+        }
+    }
+    bool FrozenNodeResult::is_number() const {
+        return _tape_type(_frozen_entry(doc, i)) == T_NUM;
+    }
+    std::string FrozenNodeResult::get_number(const std::string &def) const {
+        _Node tmp;
+        const _Node *num = _frozen_num(doc, i, &tmp);
+        if (!num) {
+            return def;
+        }
+        char buf[24];
+        size_t len = 0;
+        const char *text = _num_text(num, buf, &len);
+        return std::string(text, len);
+    }
+    bool FrozenNodeResult::is_u64() const {
+        _Node tmp;
+        return _parse_u64(_frozen_num(doc, i, &tmp), NULL);
+    }
+    uint64_t FrozenNodeResult::get_u64(uint64_t def) const {
+        _Node tmp;
+        (void)_parse_u64(_frozen_num(doc, i, &tmp), &def);
+        return def;
+    }
+    bool FrozenNodeResult::is_i64() const {
+        _Node tmp;
+        return _parse_i64(_frozen_num(doc, i, &tmp), NULL);
+    }
+    int64_t FrozenNodeResult::get_i64(int64_t def) const {
+        _Node tmp;
+        (void)_parse_i64(_frozen_num(doc, i, &tmp), &def);
+        return def;
+    }
+    bool FrozenNodeResult::is_double() const {
+        return this->is_number();
+    }
+    double FrozenNodeResult::get_double(double def) const {
+        _Node tmp;
+        const _Node *num = _frozen_num(doc, i, &tmp);
+        if (!num) {
+            return def;
+        }
+        if (!(num->flags & F_INT)) {
+            double d;
+            memcpy(&d, &doc->tape[i + 1], sizeof(double));
+            return d;
+        } else if (num->flags & F_NEG) {
+            return double(num->i64);
+        } else {
+            return double(num->u64);
+        }
+    }
+    bool FrozenNodeResult::is_str() const {
+        return _tape_type(_frozen_entry(doc, i)) == T_STR;
+    }
+    std::string FrozenNodeResult::get_str(const std::string &def) const {
+        size_t len = 0;
+        const char *str = this->get_str(&len);
+        return str ? std::string(str, len) : def;
+    }
+    const char *FrozenNodeResult::get_str(size_t *len) const {
+        uint64_t e = _frozen_entry(doc, i);
+        if (_tape_type(e) != T_STR) {
+            return NULL;
+        }
+        uint32_t n = 0;
+        const char *str = _tape_text(doc->strs, e, &n);
+        *len = n;
+        return str;
+    }
+    bool FrozenNodeResult::is_arr() const {
+        return this->get_arr().ok();
+    }
+    FrozenArrayResult FrozenNodeResult::get_arr() const {
+        FrozenArrayResult r;
+        if (_tape_type(_frozen_entry(doc, i)) == T_ARR) {
+            r.doc = doc;
+            r.i = i;
+        }
+        return r;
+    }
+    bool FrozenNodeResult::is_map() const {
+        return this->get_map().ok();
+    }
+    FrozenMapResult FrozenNodeResult::get_map() const {
+        FrozenMapResult r;
+        if (_tape_type(_frozen_entry(doc, i)) == T_MAP) {
+            r.doc = doc;
+            r.i = i;
+        }
+        return r;
+    }
+
+    // FrozenArrayResult
+    size_t FrozenArrayResult::size() const {
+        return doc ? (size_t)doc->tape[i + 1] : 0;
+    }
+    FrozenNodeResult FrozenArrayResult::at(size_t idx) const {
+        FrozenNodeResult r;
+        if (idx < this->size()) {
+            size_t cur = i + 2;
+            for (size_t n = 0; n < idx; ++n) {
+                cur = _tape_next(doc->tape, cur);
+            }
+            r.doc = doc;
+            r.i = cur;
+        }
+        return r;
+    }
+    FrozenArrayIterator FrozenArrayResult::iter() const {
+        FrozenArrayIterator r;
+        r.doc = doc;
+        r.i = i;
+        return r;
+    }
+
+    // FrozenArrayIterator
+    bool FrozenArrayIterator::next() {
+        if (!doc) {
+            return false;
+        }
+        size_t end = (size_t)_tape_payload(doc->tape[i]);
+        if (cur == 0) {
+            cur = i + 2;
+        } else if (cur < end) {
+            cur = _tape_next(doc->tape, cur);
+        }
+        return cur < end;
+    }
+    FrozenNodeResult FrozenArrayIterator::value() const {
+        FrozenNodeResult r;
+        if (doc && cur != 0 && cur < _tape_payload(doc->tape[i])) {
+            r.doc = doc;
+            r.i = cur;
+        }
+        return r;
+    }
+
+    // the index of the value of the last matching key, 0 if not found
+    static size_t _frozen_find(const FrozenDoc *doc, size_t i, const char *key, size_t len) {
+        size_t end = (size_t)_tape_payload(doc->tape[i]);
+        size_t found = 0;
+        for (size_t cur = i + 2; cur < end; cur = _tape_next(doc->tape, cur + 1)) {
+            uint32_t n = 0;
+            const char *name = _tape_text(doc->strs, doc->tape[cur], &n);
+            if (n == len && 0 == memcmp(name, key, len)) {
+                found = cur + 1;
+            }
+        }
+        return found;
+    }
+
+    // FrozenMapResult
+    size_t FrozenMapResult::size() const {
+        return doc ? (size_t)doc->tape[i + 1] : 0;
+    }
+    FrozenNodeResult FrozenMapResult::point(const char *pointer) const {
+        FrozenNodeResult r;
+        if (!doc) {
+            return r;
+        }
+        r.doc = doc;
+        r.i = i;
+        std::string key;
+        while (r.doc && pointer[0]) {
+            if (!_pointer_key(pointer, key)) {
+                return FrozenNodeResult();
+            }
+            if (r.is_map()) {
+                r = r.get_map().key(key.c_str());
+            } else if (r.is_arr()) {
+                uint64_t idx = 0;
+                if (!_parse_digits(&idx, key.data(), key.data() + key.size())) {    // NOTE: accepts non-std index
+                    // bad array index
+                    return FrozenNodeResult();
+                }
+                r = r.get_arr().at(idx);
+            } else {
+                // bad node type
+                return FrozenNodeResult();
+            }
+        }
+        return r;
+    }
+    FrozenNodeResult FrozenMapResult::key(const char *key) const {
+        FrozenNodeResult r;
+        if (doc) {
+            size_t found = _frozen_find(doc, i, key, strlen(key));
+            if (found) {
+                r.doc = doc;
+                r.i = found;
+            }
+        }
+        return r;
+    }
+    FrozenMapIterator FrozenMapResult::iter() const {
+        FrozenMapIterator r;
+        r.doc = doc;
+        r.i = i;
+        return r;
+    }
+
+    // FrozenMapIterator
+    bool FrozenMapIterator::next() {
+        if (!doc) {
+            return false;
+        }
+        size_t end = (size_t)_tape_payload(doc->tape[i]);
+        if (cur == 0) {
+            cur = i + 2;
+        } else if (cur < end) {
+            cur = _tape_next(doc->tape, cur + 1);
+        }
+        return cur < end;
+    }
+    std::string FrozenMapIterator::key() const {
+        if (!doc || cur == 0 || cur >= _tape_payload(doc->tape[i])) {
+            return g_empty_str;
+        }
+        uint32_t len = 0;
+        const char *name = _tape_text(doc->strs, doc->tape[cur], &len);
+        return std::string(name, len);
+    }
+    FrozenNodeResult FrozenMapIterator::value() const {
+        FrozenNodeResult r;
+        if (doc && cur != 0 && cur < _tape_payload(doc->tape[i])) {
+            r.doc = doc;
+            r.i = cur + 1;
         }
         return r;
     }
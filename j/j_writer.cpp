@@ -1,6 +1,5 @@
 // system
-#include <stdio.h>
-#include <math.h>
+#include <string.h>
 // proj
 #include "j.h"
 #include "j_def.h"
@@ -8,12 +7,9 @@
 
 namespace j {
 
-    static void _clear(_Node *ref) {
-        ref->type = T_DEL;
-        ref->val.clear();
-        ref->values.clear();
-        ref->keys.clear();
-        // ref->key is reserved
+    static void _clear(_Arena &arena, _Node *ref) {
+        _drop(arena, ref);
+        _node_init(ref, T_DEL);
     }
 
     static bool _parse_digits(uint64_t *out, const char *begin, const char *end) {
@@ -42,7 +38,7 @@ namespace j {
         return true;
     }
 
-    static _Node *_point(_Node *ref, const char *pointer) {
+    static _Node *_point(_Node *ref, _Arena *arena, const char *pointer) {
         while (ref && pointer[0]) {
             if (pointer[0] != '/') {
                 // not a pointer
@@ -69,15 +65,15 @@ namespace j {
             }
             // access key
             if (ref->type == T_DEL) {
-                ref->type = T_MAP;              // newly created node
+                _init(*arena, ref, T_MAP);      // newly created node
             }
             if (ref->type == T_MAP) {
                 MapResult t;
-                t.ref = ref;
+                t.bind(ref, arena);
                 ref = t.key(key.c_str()).ref;   // lookup or create
             } else if (ref->type == T_ARR) {
                 ArrayResult t;
-                t.ref = ref;
+                t.bind(ref, arena);
                 if (key == "-") {
                     ref = t.push_back().ref;
                 } else {
@@ -97,58 +93,63 @@ namespace j {
         return ref;
     }
 
-    static void _set_u64(_Node *ref, uint64_t val) {
-        _clear(ref);
-        ref->type = T_NUM;
-        char buf[32];
-        int n = snprintf(buf, sizeof(buf), "%llu", (unsigned long long)val);
-        ref->val.assign(buf, n);
-    }
-
-    static void _set_i64(_Node *ref, int64_t val) {
-        _clear(ref);
-        ref->type = T_NUM;
-        char buf[32];
-        int n = snprintf(buf, sizeof(buf), "%lld", (signed long long)val);
-        ref->val.assign(buf, n);
-    }
-
-    static void _set_double(_Node *ref, double val) {
-        _clear(ref);
-        ref->type = T_NUM;
-        int cls = fpclassify(val);
-        if (cls == FP_NAN) {
-            ref->val = "NaN";
-        } else if (cls == FP_INFINITE) {
-            ref->val = (val > 0) ? "Infinity" : "-Infinity";
-        } else {
-            char buf[32];
-            int n = snprintf(buf, sizeof(buf), "%.17g", val);
-            ref->val.assign(buf, n);
-        }
-    }
-
     // NodeResult
     void NodeResult::set(ConstNodeResult src) {
         if (!ref || !src.ref) {
             return;
         }
 
-        // copy from src, but don't touch ref->key
-        ref->type = src.ref->type;  // XXX: what if src.ref->type == T_DEL
-        ref->val = src.ref->val;
-        ref->values = src.ref->values;
-        ref->keys = src.ref->keys;
+        // the key of ref is kept by the parent map
+        // NOTE: src may be a child of ref, it is shared before ref is dropped
+        _Node tmp;
+        _share(*arena, &tmp, src.ref, src.arena);   // XXX: what if src.ref->type == T_DEL
+        _drop(*arena, ref);
+        *ref = tmp;
     }
     void NodeResult::set(NodeResult src) {
-        set((ConstNodeResult &)src);
+        ConstNodeResult c;
+        c.ref = src.ref;
+        c.arena = src.arena;
+        set(c);
+    }
+    void NodeResult::adopt(Doc &src) {
+        if (!ref || !src.ref || src.arena == arena) {
+            return;
+        }
+
+        _Node tmp = *src.ref;
+        _unlink_all(*src.arena);
+        if (_arena_merge(*arena, src.arena)) {
+            // the memory of src is owned by arena now
+            src.ref = NULL;
+            src.arena = NULL;
+        } else {
+            // src is shared by others
+            _share(*arena, &tmp, src.ref, src.arena);
+            _drop(*src.arena, src.ref);
+            src.clear();
+        }
+        _drop(*arena, ref);
+        *ref = tmp;
+    }
+    _MovingNode NodeResult::detach() {
+        if (!ref) {
+            return _MovingNode(NULL, NULL);
+        }
+
+        _Arena *dst = _arena_new(arena->allocator);
+        _Node *root = dst->new_node();
+        _share(*dst, root, ref, arena);
+        _drop(*arena, ref);
+        _node_init(ref, T_NULL);
+        return _MovingNode(root, dst);
     }
     void NodeResult::set_null() {
         if (!ref) {
             return;
         }
 
-        _clear(ref);
+        _clear(*arena, ref);
         ref->type = T_NULL;
     }
     void NodeResult::set_bool(bool val) {
@@ -156,89 +157,122 @@ namespace j {
             return;
         }
 
-        _clear(ref);
+        _clear(*arena, ref);
         ref->type = val ? T_TRUE : T_FALSE;
     }
     void NodeResult::set_u64(uint64_t val) {
         if (!ref) {
             return;
         }
-        _set_u64(ref, val);
+        _drop(*arena, ref);
+        _set_u64(*arena, ref, val);
     }
     void NodeResult::set_i64(int64_t val) {
         if (!ref) {
             return;
         }
-        _set_i64(ref, val);
+        _drop(*arena, ref);
+        _set_i64(*arena, ref, val);
     }
     void NodeResult::set_double(double val) {
         if (!ref) {
             return;
         }
-        _set_double(ref, val);
+        _drop(*arena, ref);
+        _set_double(*arena, ref, val);
+    }
+    void NodeResult::set_float(float val) {
+        if (!ref) {
+            return;
+        }
+        _drop(*arena, ref);
+        _set_float(*arena, ref, val);
     }
     void NodeResult::set_str(const std::string &val) {
         if (!ref) {
             return;
         }
 
-        _clear(ref);
-        ref->type = T_STR;
-        ref->val = val;
+        _drop(*arena, ref);
+        _set_text(*arena, ref, T_STR, val.data(), val.size());
     }
     ArrayResult NodeResult::set_arr() {
         if (ref && ref->type != T_ARR) {
-            _clear(ref);
-            ref->type = T_ARR;
+            _drop(*arena, ref);
+            _init(*arena, ref, T_ARR);
         }
         ArrayResult r;
-        r.ref = ref;
+        r.bind(ref, arena);
         return r;
     }
     MapResult NodeResult::set_map() {
         if (ref && ref->type != T_MAP) {
-            _clear(ref);
-            ref->type = T_MAP;
+            _drop(*arena, ref);
+            _init(*arena, ref, T_MAP);
         }
         MapResult r;
-        r.ref = ref;
+        r.bind(ref, arena);
         return r;
     }
 
     // ArrayResult
     NodeResult ArrayResult::at(size_t i) {
         NodeResult r;
-        if (ref && i < ref->values.size()) {
-            r.ref = &ref->values[i];
+        if (ref && i < ref->arr->size) {
+            r.bind(&_writable_arr(*arena, ref)->values[i], arena);
         }
         return r;
     }
     NodeResult ArrayResult::push_back() {
         NodeResult r;
         if (ref) {
-            ref->values.push_back(_Node());
-            r.ref = &ref->values.back();
+            r.bind(_arr_push(*arena, _writable_arr(*arena, ref)), arena);
         }
         return r;
     }
     void ArrayResult::erase(size_t i) {
-        if (ref && i < ref->values.size()) {
-            ref->values.erase(ref->values.begin() + i);
+        if (ref && i < ref->arr->size) {
+            _arr_erase(*arena, _writable_arr(*arena, ref), (uint32_t)i);
         }
     }
     ArrayResult ArrayResult::clear() {
         ArrayResult r;
         if (ref) {
-            ref->values.clear();
-            r.ref = ref;
+            _Array *arr = ref->arr;
+            if (arr->refs == 1 && arr->arena->owner() == arena) {
+                for (uint32_t i = 0; i < arr->size; ++i) {
+                    _drop(*arena, &arr->values[i]);
+                }
+                _relocate(*arena, arr->values, arr->size, NULL);
+                arr->size = 0;
+            } else {
+                _drop(*arena, ref);
+                _init(*arena, ref, T_ARR);  // leave the shared one
+            }
+            r.bind(ref, arena);
         }
         return r;
     }
 
+    size_t ArrayResult::capacity() const {
+        return ref ? ref->arr->cap : 0;
+    }
+    void ArrayResult::reserve(size_t n) {
+        if (ref) {
+            _arr_reserve(*arena, _writable_arr(*arena, ref), n);
+        }
+    }
+    void ArrayResult::shrink_to_fit() {
+        if (ref) {
+            _arr_shrink(*arena, _writable_arr(*arena, ref));
+        }
+    }
+
     // MapResult
     NodeResult MapResult::point(const char *pointer) {
         NodeResult r;
-        r.ref = _point(ref, pointer);
+        _Node *node = _point(ref, arena, pointer);
+        r.bind(node, node ? arena : NULL);
         return r;
     }
     NodeResult MapResult::key(const char *key) {
@@ -246,79 +280,116 @@ namespace j {
         if (!ref) {
             return r;
         }
-        std::map<std::string, size_t>::iterator it = ref->keys.find(key);
-        if (it == ref->keys.end()) {
+        size_t len = strlen(key);
+        _Map *map = _writable_map(*arena, ref);
+        _Node *node = _map_find(map, key, len);
+        if (!node) {
             // insert new key
-            ref->keys[key] = ref->values.size();
-            ref->values.push_back(_Node());
-            r.ref = &ref->values.back();
-            r.ref->key = key;
-        } else {
-            r.ref = &ref->values[it->second];
+            node = _map_push(*arena, map, key, len);
         }
+        r.bind(node, arena);
         return r;
     }
     MapIterator MapResult::iter() {
         MapIterator r;
-        r.ref = ref;
+        if (ref) {
+            _writable_map(*arena, ref);
+        }
+        r.bind(ref, arena);
         return r;
     }
     bool MapResult::erase(const char *key) {
         if (!ref) {
             return false;
         }
-        std::map<std::string, size_t>::iterator it = ref->keys.find(key);
-        if (it != ref->keys.end()) {
-            _Node *node = &ref->values[it->second];
-            _clear(node);
-            node->type = T_DEL;
-            ref->keys.erase(it);
-            return true;
-        } else {
-            return false;
-        }
+        return _map_erase(*arena, _writable_map(*arena, ref), key, strlen(key));
     }
     MapResult MapResult::clear() {
         MapResult r;
         if (ref) {
-            ref->values.clear();
-            ref->keys.clear();
-            r.ref = ref;
+            _Map *map = ref->map;
+            if (map->refs == 1 && map->arena->owner() == arena) {
+                _map_clear(*arena, map);
+            } else {
+                _drop(*arena, ref);
+                _init(*arena, ref, T_MAP);  // leave the shared one
+            }
+            r.bind(ref, arena);
+        }
+        return r;
+    }
+
+    MapResult MapResult::compact() {
+        MapResult r;
+        if (ref) {
+            _map_compact(*arena, _writable_map(*arena, ref));
+            r.bind(ref, arena);
         }
         return r;
     }
 
     // MapIterator, reuse ConstMapIterator
     bool MapIterator::next() {
-        return ((ConstMapIterator *)this)->next();
+        return ConstMapIterator::next();
     }
     const std::string &MapIterator::key() const {
-        return ((ConstMapIterator *)this)->key();
+        return ConstMapIterator::key();
     }
     NodeResult MapIterator::value() const {
+        ConstNodeResult v = ConstMapIterator::value();
         NodeResult r;
-        r.ref = ((ConstMapIterator *)this)->value().ref;
+        r.bind(v.ref, v.arena);
         return r;
     }
 
     // Doc
     NodeResult Doc::set_root() {
+        if (!arena) {
+            arena = _arena_new(allocator);
+        }
         if (!ref) {
-            ref = new _Node();
+            ref = arena->new_node();
         }
         NodeResult r;
-        r.ref = ref;
+        r.bind(ref, arena);
         return r;
     }
     Doc &Doc::clear() {
-        delete this->ref;
+        if (this->arena) {
+            _unlink_all(*this->arena);
+            _discard(*this->arena, this->ref);
+            _arena_release(this->arena);
+        }
+        this->arena = NULL;
         this->ref = NULL;
         return *this;
     }
+    Doc &Doc::reserve(size_t nodes, size_t bytes) {
+        if (!arena) {
+            arena = _arena_new(allocator);
+        }
+        arena->reserve(sizeof(_Node) * nodes + bytes);
+        return *this;
+    }
+    Doc &Doc::shrink() {
+        if (!this->ref) {
+            return this->clear();
+        }
+        _Arena *dst = _arena_new(this->arena->allocator);
+        _Node *root = dst->new_node();
+        _copy(*dst, root, this->ref);
+        _unlink_all(*this->arena);
+        _discard(*this->arena, this->ref);
+        _arena_release(this->arena);
+        this->arena = dst;
+        this->ref = root;
+        return *this;
+    }
     _MovingNode Doc::move() {
-        _Node *p = this->ref;
+        _MovingNode r(this->ref, this->arena);
         this->ref = NULL;
-        return _MovingNode(p);
+        this->arena = NULL;
+        return r;
     }
 
 }   // ::j
@@ -19,7 +19,10 @@ def d(file):
 
 def rules(ctx):
     c_lib_files = [
+        'j/j_arena.cpp',
         'j/j_dumper.cpp',
+        'j/j_map.cpp',
+        'j/j_num.cpp',
         'j/j_parser.cpp',
         'j/j_reader.cpp',
         'j/j_writer.cpp',
@@ -59,8 +62,44 @@ def rules(ctx):
         ctx.add_rule(o_file, [file], cmd, d_file=d_file)
         cxx98_o_files.append(o_file)
 
+    # -fno-exceptions compile test
+    noexcept_o_files = []
+    for file in c_lib_files:
+        o_file = '_out/' + file.replace('.cpp', '.noexcept.o')
+        d_file = '_out/' + file.replace('.cpp', '.noexcept.d')
+        cmd = [CXX, *CXXFLAGS, '-fno-exceptions', '-o', o_file, '-c', file, '-MD', '-MP']
+        ctx.add_rule(o_file, [file], cmd, d_file=d_file)
+        noexcept_o_files.append(o_file)
+
     # dummy test target
-    ctx.add_rule('test', test_exe_files + cxx98_o_files, ['true'])
+    ctx.add_rule('test', test_exe_files + cxx98_o_files + noexcept_o_files, ['true'])
+
+    # benchmarks, optimized and without coverage
+    bench_flags = [x for x in CXXFLAGS if x not in ('-Og', '--coverage')] + ['-O2']
+    c_bench_files = [
+        'bench/bench_memory.cpp',
+        'bench/bench_map.cpp',
+        'bench/bench_number.cpp',
+        'bench/bench_array.cpp',
+        'bench/bench_frozen.cpp',
+        'bench/bench_parser.cpp',
+    ]
+    bench_o_lib_files = []
+    for file in c_lib_files:
+        o_file = '_out/' + file.replace('.cpp', '.bench.o')
+        d_file = '_out/' + file.replace('.cpp', '.bench.d')
+        cmd = [CXX, *bench_flags, '-o', o_file, '-c', file, '-MD', '-MP']
+        ctx.add_rule(o_file, [file], cmd, d_file=d_file)
+        bench_o_lib_files.append(o_file)
+    bench_exe_files = []
+    for file in c_bench_files:
+        exe_file = file.replace('bench/', '').replace('.cpp', '')
+        o_file = o(file)
+        ctx.add_rule(o_file, [file], [CXX, *bench_flags, '-o', o_file, '-c', file, '-MD', '-MP'], d_file=d(file))
+        o_files = bench_o_lib_files + [o_file]
+        ctx.add_rule(exe_file, o_files, [LD, '-o', exe_file, *o_files])
+        bench_exe_files.append(exe_file)
+    ctx.add_rule('bench', bench_exe_files, ['true'])
 
     # coverage
     ctx.add_rule('lcov-zero', [], ['lcov --directory . --zerocounters'.split()])
@@ -2,6 +2,8 @@
 
 // system
 #include <cmath>
+#include <stdlib.h>
+#include <string.h>
 // proj
 #include "../j/j.h"
 
@@ -12,6 +14,16 @@
 using std::isinf;
 using std::isnan;
 
+#if defined(__GLIBC__) && !defined(__SANITIZE_ADDRESS__)
+// count the allocations by interposing malloc()
+extern "C" void *__libc_malloc(size_t size);
+static size_t g_mallocs = 0;
+extern "C" void *malloc(size_t size) throw() {
+    g_mallocs++;
+    return __libc_malloc(size);
+}
+#endif
+
 
 TEST_CASE("parser.coverage.ok") {
     j::Parser p;
@@ -71,6 +83,38 @@ TEST_CASE("parser.coverage.bad") {
     CHECK_FALSE(p.parse("[][]", doc));
 }
 
+TEST_CASE("parser.error") {
+    j::Parser p;
+    j::Doc doc;
+    j::FrozenDoc frozen;
+    const char *cases[][2] = {
+        {"", "unexpected eof"},
+        {"[1 2]", "expect comma"},
+        {"{\"a\" 1}", "expect colon"},
+        {"{1:1}", "expect string"},
+        {"\"abc", "string not terminated"},
+        {"\"\\u12g4\"", "not hex digits"},
+        {"-x", "expected 0123456789"},
+        {"1.e", "expected frac digits"},
+        {"[[[1]]] 1", "trailing garbage"},
+        {"nul", "not json"},
+    };
+    size_t where[] = {0, 3, 5, 1, 4, 3, 1, 2, 8, 0};
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); ++i) {
+        CAPTURE(cases[i][0]);
+        CHECK_FALSE(p.parse(cases[i][0], doc));
+        CHECK(std::string(p.what()) == cases[i][1]);
+        CHECK(p.where() == where[i]);
+        CHECK_FALSE(p.parse(cases[i][0], frozen));
+        CHECK(std::string(p.what()) == cases[i][1]);
+        CHECK(p.where() == where[i]);
+    }
+    // cleared on success
+    CHECK(p.parse("1", doc));
+    CHECK(std::string(p.what()) == "");
+    CHECK(p.where() == 0);
+}
+
 TEST_CASE("parser.surrogate.ok") {
     j::Parser p;
     j::Doc doc;
@@ -91,6 +135,54 @@ TEST_CASE("parser.surrogate.bad") {
     CHECK(doc.get_str("") == "\xed\xa0\xbd\\");
 }
 
+TEST_CASE("parser.unescape.once") {
+    // the escapes are decoded into the Doc by the first get_str() only
+    j::Parser p;
+    j::Doc doc;
+    REQUIRE(p.parse(STR(["a string longer than the inline buffer\tb"]), doc));
+    j::ConstNodeResult node = doc.get_arr().at(0);
+    size_t usage = doc.memory_usage();
+    CHECK("[\"a string longer than the inline buffer\\u0009b\"]" == j::Dumper().dump(doc));
+    CHECK(usage == doc.memory_usage());
+    const std::string &str = node.get_str("");
+    CHECK("a string longer than the inline buffer\tb" == str);
+    CHECK(usage < doc.memory_usage());
+    usage = doc.memory_usage();
+    CHECK(&str == &node.get_str(""));
+    CHECK(usage == doc.memory_usage());
+}
+
+TEST_CASE("parser.unescape.lazy") {
+    j::Parser p;
+    j::Doc doc;
+    j::Dumper d;
+    REQUIRE(p.parse(STR(["a\tb","\u00e9\/",{"k\"":"\ud83d\ude02"}]), doc));
+    CHECK("[\"a\\u0009b\",\"\xc3\xa9/\",{\"k\\\"\":\"\xf0\x9f\x98\x82\"}]" == d.dump(doc));
+
+    // decoded by either Doc sharing the raw text
+    j::Doc cloned(doc.clone());
+    cloned.set_arr().push_back().set_null();
+    CHECK("a\tb" == cloned.get_arr().at(0).get_str(""));
+    CHECK("a\tb" == doc.get_arr().at(0).get_str(""));
+    CHECK("\xc3\xa9/" == doc.get_arr().at(1).get_str(""));
+    CHECK("\xc3\xa9/" == cloned.get_arr().at(1).get_str(""));
+    CHECK("\xf0\x9f\x98\x82" == doc.get_arr().at(2).get_map().key("k\"").get_str(""));
+    j::Doc copied;
+    copied.set_arr().push_back().set(cloned.get_arr().at(2));
+    CHECK("\xf0\x9f\x98\x82" == copied.get_arr().at(0).get_map().key("k\"").get_str(""));
+    CHECK("[\"a\\u0009b\",\"\xc3\xa9/\",{\"k\\\"\":\"\xf0\x9f\x98\x82\"},null]" == d.dump(cloned));
+
+    // the borrowed text is decoded on the first access
+    p.borrow_input = true;
+    std::string input = STR(["x\ty"]);
+    REQUIRE(p.parse(input, doc));
+    input[input.find("x")] = 'X';
+    CHECK("X\ty" == doc.get_arr().at(0).get_str(""));
+    input[input.find("X")] = 'x';
+    CHECK("X\ty" == doc.get_arr().at(0).get_str(""));
+    CHECK(STR(["X\u0009y"]) == d.dump(doc));
+}
+
 TEST_CASE("parser.map.dup.key") {
     j::Parser p;
     j::Doc doc;
@@ -109,6 +201,122 @@ TEST_CASE("parser.utf8") {
     CHECK(expect == doc.get_str(""));
 }
 
+// the offset of the first invalid sequence, or npos
+static size_t utf8_error(const std::string &str) {
+    const uint32_t min_code[] = {0, 0, 0x80, 0x800, 0x10000};
+    size_t i = 0;
+    while (i < str.size()) {
+        uint8_t lead = (uint8_t)str[i];
+        size_t n = lead < 0x80 ? 1 : lead < 0xC0 ? 0 : lead < 0xE0 ? 2 : lead < 0xF0 ? 3 : lead < 0xF8 ? 4 : 0;
+        if (n == 0 || i + n > str.size()) {
+            return i;
+        }
+        uint32_t code = n == 1 ? lead : lead & (0x7F >> n);
+        for (size_t k = 1; k < n; ++k) {
+            if (((uint8_t)str[i + k] & 0xC0) != 0x80) {
+                return i;
+            }
+            code = (code << 6) | ((uint8_t)str[i + k] & 0x3F);
+        }
+        if (code < min_code[n] || code > 0x10FFFF || (0xD800 <= code && code <= 0xDFFF)) {
+            return i;
+        }
+        i += n;
+    }
+    return std::string::npos;
+}
+
+TEST_CASE("parser.validate_string") {
+    j::Parser p;
+    j::Parser q;
+    p.validate_string = true;
+    q.validate_string = true;
+    q.structural_index = true;
+    j::Doc doc;
+    j::FrozenDoc frozen;
+
+    // the escapes are not checked
+    CHECK(p.parse("[\"\xc3\xa9\\ud800\", \"\xf4\x8f\xbf\xbf\"]", doc));
+    CHECK("\xf4\x8f\xbf\xbf" == doc.get_arr().at(1).get_str(""));
+    CHECK(q.parse("[\"\xc3\xa9\\ud800\", \"\xf4\x8f\xbf\xbf\"]", doc));
+
+    const char *cases[] = {
+        "[\"\xff\"]",                       // not a lead byte
+        "[\"ab\x80\"]",                     // lone continuation
+        "[\"ab\xc0\xaf\"]",                 // overlong
+        "[\"ab\xe0\x80\xaf\"]",             // overlong
+        "[\"\xed\xa0\x80\"]",               // surrogate
+        "[\"\xf4\x90\x80\x80\"]",           // above U+10FFFF
+        "[\"\xe2\x82\"]",                   // truncated
+        "[\"\xe2\x82\\n\"]",                // truncated by an escape
+        "{\"a\": 1, \"b\xe9\": 2}",         // in key
+    };
+    size_t where[] = {2, 4, 4, 4, 2, 2, 2, 2, 11};
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); ++i) {
+        CAPTURE(cases[i]);
+        CHECK(j::Parser().parse(cases[i], doc));
+        CHECK_FALSE(p.parse(cases[i], doc));
+        CHECK(std::string(p.what()) == "bad utf-8");
+        CHECK(p.where() == where[i]);
+        CHECK_FALSE(p.parse(cases[i], frozen));
+        CHECK(p.where() == where[i]);
+        CHECK_FALSE(q.parse(cases[i], doc));
+        CHECK(q.where() == where[i]);
+    }
+
+    // the first error in the string is reported
+    const char *firsts[] = {"[\"\xff\x01\"]", "[\"\x01\xff\"]", "[\"\xff\\x\"]", "[\"\xe2\x82"};
+    const char *whats[] = {"bad utf-8", "unescaped control char", "bad utf-8", "string not terminated"};
+    for (size_t i = 0; i < sizeof(firsts) / sizeof(firsts[0]); ++i) {
+        CAPTURE(firsts[i]);
+        CHECK_FALSE(p.parse(firsts[i], doc));
+        CHECK(std::string(p.what()) == whats[i]);
+        CHECK_FALSE(q.parse(firsts[i], doc));
+        CHECK(std::string(q.what()) == whats[i]);
+    }
+
+    // the random strings across the vector blocks
+    uint64_t seed = 1;
+    for (int i = 0; i < 20000; ++i) {
+        std::string str;
+        int pieces = int(seed % 8) + 1;
+        for (int k = 0; k < pieces; ++k) {
+            seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+            uint32_t r = uint32_t(seed >> 33);
+            uint32_t kind = r % 64;
+            if (kind < 16) {
+                str.append(r % 40, 'a' + r % 26);
+            } else if (kind < 62) {
+                // a valid code point of 2, 3 or 4 bytes
+                uint32_t code = kind % 3 == 0 ? 0x80 + r % 0x780 : kind % 3 == 1 ? 0x800 + r % 0xf800 : 0x10000 + r % 0x100000;
+                if (0xD800 <= code && code <= 0xDFFF) {
+                    code = 0xFFFD;
+                }
+                char buf[4];
+                size_t n = code < 0x800 ? 2 : code < 0x10000 ? 3 : 4;
+                for (size_t b = n - 1; b > 0; --b) {
+                    buf[b] = char(0x80 | (code & 0x3F));
+                    code >>= 6;
+                }
+                buf[0] = char((0xF00 >> n) | code);
+                // truncated sometimes
+                str.append(buf, kind == 61 ? n - 1 : n);
+            } else {
+                str.push_back(char(0x80 + r % 0x80));
+            }
+        }
+        std::string input = "[\"" + str + "\"]";
+        CAPTURE(input);
+        size_t err = utf8_error(str);
+        REQUIRE((err == std::string::npos) == p.parse(input, doc));
+        REQUIRE((err == std::string::npos) == q.parse(input, doc));
+        if (err != std::string::npos) {
+            CHECK(p.where() == err + 2);
+            CHECK(q.where() == err + 2);
+        }
+    }
+}
+
 TEST_CASE("parser.cleanup") {
     j::Parser p;
     j::Doc doc;
@@ -172,6 +380,55 @@ TEST_CASE("parser.num.conversion") {
     CHECK(doc.get_double(0.0) == (double)3622009729038561421);
 }
 
+TEST_CASE("parser.num.digits") {
+    j::Parser p;
+    j::Doc doc;
+    j::Dumper d;
+
+    // every length of the digit runs, at the end of the input and followed by 8 or more chars
+    const char *digits = "98765432109876543210987654321";
+    for (size_t n = 1; n < strlen(digits); ++n) {
+        std::string num(digits, n);
+        CAPTURE(num);
+        uint64_t val = strtoull(num.c_str(), NULL, 10);
+        bool fits = n < 20 || (n == 20 && num <= "18446744073709551615");
+        const char *tails[] = {"", "]", ",1]         ", ",\xff]        ", ".5e10]       "};
+        for (size_t t = 0; t < sizeof(tails) / sizeof(tails[0]); ++t) {
+            std::string input = std::string(*tails[t] ? "[" : "") + num + tails[t];
+            CAPTURE(input);
+            REQUIRE(p.parse(input, doc) == (t != 3));
+            j::ConstNodeResult node = *tails[t] ? doc.get_arr().at(0) : doc.get_root();
+            if (t == 4) {
+                CHECK(node.get_number("") == num + ".5e10");
+            } else if (t != 3) {
+                CHECK(node.is_u64() == fits);
+                CHECK(node.get_number("") == num);
+                if (fits) {
+                    CHECK(node.get_u64(0) == val);
+                }
+            }
+        }
+        // negative
+        std::string input = "[-" + num + ",-" + num + ".0" + num + "e-" + num + "]";
+        CAPTURE(input);
+        REQUIRE(p.parse(input, doc));
+        CHECK(d.dump(doc) == input);
+    }
+
+    CHECK(p.parse("[-9223372036854775808]", doc));
+    CHECK(doc.get_arr().at(0).is_i64());
+    CHECK(p.parse("[-9223372036854775809]", doc));
+    CHECK_FALSE(doc.get_arr().at(0).is_i64());
+
+    // the digits after a leading zero or a dot are required
+    CHECK_FALSE(p.parse("[00000000000]", doc));
+    CHECK_FALSE(p.parse("[1.e12345678]", doc));
+    CHECK(std::string(p.what()) == "expected frac digits");
+    CHECK_FALSE(p.parse("[1.12345678e]", doc));
+    CHECK(std::string(p.what()) == "expected exp digits");
+    CHECK(p.where() == 12);
+}
+
 TEST_CASE("parser.comments") {
     j::Parser p;
     j::Doc doc;
@@ -198,6 +455,201 @@ TEST_CASE("parser.comments") {
     CHECK(doc.is_arr());
 }
 
+TEST_CASE("parser.space") {
+    j::Parser p;
+    j::Doc doc;
+    // runs across the vector widths
+    for (size_t n = 0; n < 80; ++n) {
+        std::string sp;
+        for (size_t i = 0; i < n; ++i) {
+            sp.push_back(" \t\r\n"[i % 4]);
+        }
+        REQUIRE(p.parse(sp + "[" + sp + "1" + sp + "," + sp + "{" + sp + "\"a\"" + sp + ":" + sp + "2}]" + sp, doc));
+        CHECK(doc.get_arr().at(1).get_map().key("a").get_u64(0) == 2);
+
+        CHECK_FALSE(p.parse(sp, doc));
+        CHECK(p.where() == n);
+        CHECK_FALSE(p.parse("1" + sp + "x" + sp, doc));
+        CHECK(p.where() == n + 1);
+        CHECK_FALSE(p.parse("[" + sp + "\v]", doc));
+        CHECK(p.where() == n + 1);
+
+        p.allow_comment = true;
+        CHECK(p.parse(sp + "/*" + sp + "*/" + sp + "[1 //" + sp + "\n" + sp + "]" + sp + "//" + sp, doc));
+        CHECK(doc.get_arr().at(0).get_u64(0) == 1);
+        p.allow_comment = false;
+    }
+}
+
+TEST_CASE("parser.str.long") {
+    j::Parser p;
+    j::Doc doc;
+    // the special char at every position across the vector widths
+    for (size_t n = 0; n < 80; ++n) {
+        std::string plain;
+        for (size_t i = 0; i < n; ++i) {
+            plain.push_back("abc\x7f\xe4\xb8\xad"[i % 7]);
+        }
+        REQUIRE(p.parse("[\"" + plain + "\"," + std::string(n, ' ') + "\"" + plain + "\"]", doc));
+        CHECK(doc.get_arr().at(0).get_str("") == plain);
+        CHECK(doc.get_arr().at(1).get_str("") == plain);
+
+        REQUIRE(p.parse("\"" + plain + "\\n\\u00e9" + plain + "\"", doc));
+        CHECK(doc.get_str("") == plain + "\n\xc3\xa9" + plain);
+
+        CHECK_FALSE(p.parse("\"" + plain + "\x1f" + plain + "\"", doc));
+        CHECK(p.where() == n + 1);
+        CHECK_FALSE(p.parse("\"" + plain, doc));
+        CHECK(p.where() == n + 1);
+    }
+}
+
+TEST_CASE("parser.structural_index") {
+    j::Parser p;
+    j::Parser q;
+    q.structural_index = true;
+    j::Doc doc;
+    j::Doc other;
+    j::Dumper d;
+    // the escapes and the strings across the 64 bytes blocks
+    for (size_t n = 0; n < 140; ++n) {
+        std::string pad(n, ' ');
+        std::string inputs[] = {
+            pad + STR({"a": [1, -2.5, "x\\\"y", true, null, {"b\u00e9": "\\\\"}], "c": ""}),
+            pad + "[\"" + std::string(n, 'z') + "\\\\\\\"\", 1]",
+            pad + "[\"" + std::string(n, '\\') + "\"]",
+            pad + "{\"" + std::string(n, 'k') + "\": {}}  ",
+            pad + "[1 2]",
+            pad + "[\"a\x01\"]",
+            pad + "[tru]",
+            pad + "[1,]",
+            pad + "\"abc",
+            pad + "{\"a\" 1}",
+        };
+        for (size_t i = 0; i < sizeof(inputs) / sizeof(inputs[0]); ++i) {
+            CAPTURE(inputs[i]);
+            bool ok = p.parse(inputs[i], doc);
+            REQUIRE(ok == q.parse(inputs[i], other));
+            if (ok) {
+                CHECK(d.dump(doc) == d.dump(other));
+            } else {
+                CHECK(p.where() == q.where());
+                CHECK(std::string(p.what()) == q.what());
+            }
+        }
+    }
+
+    q.allow_extra_comma = true;
+    REQUIRE(q.parse("[1, {\"a\": 2,},]", doc));
+    CHECK(d.dump(doc) == STR([1,{"a":2}]));
+
+    q.recursion_limit = 3;
+    CHECK(q.parse("[[[]]]", doc));
+    CHECK_FALSE(q.parse("[[[[]]]]", doc));
+    CHECK(std::string(q.what()) == "recursion limit");
+
+    // the plain strings refer to the input
+    q.borrow_input = true;
+    std::string input = STR(["abc", "d\ne"]);
+    REQUIRE(q.parse(input, doc));
+    input[input.find("abc")] = 'A';
+    CHECK("Abc" == doc.get_arr().at(0).get_str(""));
+    CHECK("d\ne" == doc.get_arr().at(1).get_str(""));
+}
+
+TEST_CASE("parser.deep") {
+    // [{"a":[{"a":...1}]}], the depth is 2 * n + 1
+    const size_t n = 50000;
+    std::string input;
+    for (size_t i = 0; i < n; ++i) {
+        input += "[{\"a\":";
+    }
+    input += "1";
+    for (size_t i = 0; i < n; ++i) {
+        input += "}]";
+    }
+
+    j::Parser p;
+    j::Doc doc;
+    j::FrozenDoc frozen;
+    p.recursion_limit = 100;
+    CHECK_FALSE(p.parse(input, doc));
+    CHECK(std::string(p.what()) == "recursion limit");
+    CHECK(p.where() == 300);
+    CHECK_FALSE(p.parse(input, frozen));
+    CHECK(std::string(p.what()) == "recursion limit");
+
+    p.recursion_limit = 2 * n + 1;
+    for (int indexed = 0; indexed < 2; ++indexed) {
+        p.structural_index = !!indexed;
+        REQUIRE(p.parse(input, doc));
+        j::ConstNodeResult node = doc.get_root();
+        for (size_t i = 0; i < n; ++i) {
+            node = node.get_arr().at(0).get_map().key("a");
+        }
+        CHECK(node.get_u64(0) == 1);
+    }
+    REQUIRE(p.parse(input, frozen));
+    j::FrozenNodeResult fnode = frozen.get_root();
+    for (size_t i = 0; i < n; ++i) {
+        fnode = fnode.get_arr().at(0).get_map().key("a");
+    }
+    CHECK(fnode.get_u64(0) == 1);
+
+    // one level more
+    p.recursion_limit = 2 * n;
+    CHECK_FALSE(p.parse(input, doc));
+    CHECK(std::string(p.what()) == "recursion limit");
+    CHECK(p.where() == 6 * n);
+    CHECK_FALSE(p.parse(input, frozen));
+    CHECK(p.where() == 6 * n);
+
+    // unclosed
+    p.recursion_limit = 2 * n + 1;
+    input.resize(input.size() - 1);
+    CHECK_FALSE(p.parse(input, doc));
+    CHECK(std::string(p.what()) == "unexpected eof");
+    CHECK_FALSE(p.parse(input, frozen));
+    CHECK(std::string(p.what()) == "unexpected eof");
+}
+
+TEST_CASE("parser.deep.default") {
+    // [{"a":[{"a":...1}]}], the depth is 2 * n + 1, the default limit is far beyond it
+    const size_t n = 5000;
+    std::string input;
+    for (size_t i = 0; i < n; ++i) {
+        input += "[{\"a\":";
+    }
+    input += "1";
+    for (size_t i = 0; i < n; ++i) {
+        input += "}]";
+    }
+
+    j::Parser p;
+    j::Dumper d;
+    j::Dumper indented;
+    indented.indent = 1;
+    j::FrozenDoc frozen;
+    REQUIRE(p.parse(input, frozen));
+    CHECK(input == d.dump(frozen));
+    const std::string text = indented.dump(frozen);
+    for (int indexed = 0; indexed < 2; ++indexed) {
+        p.structural_index = !!indexed;
+        j::Doc doc;
+        REQUIRE(p.parse(input, doc));
+        CHECK(2 * n + 1 == doc.get_root().memory_stats().max_depth);
+        CHECK(input == d.dump(doc));
+        CHECK(text == indented.dump(doc));
+        j::Doc cloned(doc.clone());
+        cloned.set_arr().push_back().set_null();
+        CHECK(input == d.dump(doc));
+        doc.shrink();
+        CHECK(input == d.dump(doc));
+        REQUIRE(p.parse(text, doc));
+        CHECK(input == d.dump(doc));
+    }
+}
+
 TEST_CASE("parser.comma") {
     j::Parser p;
     j::Doc doc;
@@ -219,3 +671,126 @@ TEST_CASE("parser.comma") {
 }
 
 // TODO: more cases
+
+TEST_CASE("parser.map.dup.key.large") {
+    j::Parser p;
+    j::Doc doc;
+    j::Dumper d;
+    REQUIRE(p.parse(STR({"a":1,"b":2,"c":3,"d":4,"e":5,"f":6,"g":7,"h":8,"i":9,"a":10,"j":11,"b":12}), doc));
+    CHECK(10 == doc.get_map().size());
+    CHECK(10 == doc.get_map().key("a").get_u64(0));
+    CHECK(12 == doc.get_map().key("b").get_u64(0));
+    CHECK(STR({"c":3,"d":4,"e":5,"f":6,"g":7,"h":8,"i":9,"a":10,"j":11,"b":12}) == d.dump(doc));
+}
+
+TEST_CASE("parser.reuse") {
+    j::Parser p;
+    j::Doc doc;
+    j::Dumper d;
+    std::string input[2];
+    for (int k = 0; k < 2; ++k) {
+        input[k] = "[";
+        for (int i = 0; i < 1000; ++i) {
+            char buf[64];
+            snprintf(buf, sizeof(buf), "%s{\"id\":%d,\"v\":[%d.5,\"s%d\"]}", i ? "," : "", i, k, i);
+            input[k] += buf;
+        }
+        input[k] += "]";
+    }
+
+    // steady state
+    REQUIRE(p.parse(input[0], doc));
+    REQUIRE(p.parse(input[1], doc));
+    size_t usage = doc.memory_usage();
+    bool ok = true;
+#if defined(__GLIBC__) && !defined(__SANITIZE_ADDRESS__)
+    size_t mallocs = g_mallocs;
+#endif
+    for (int r = 0; r < 10; ++r) {
+        ok = p.parse(input[r % 2], doc) && ok;
+    }
+#if defined(__GLIBC__) && !defined(__SANITIZE_ADDRESS__)
+    CHECK(mallocs == g_mallocs);
+#endif
+    CHECK(ok);
+    CHECK(usage == doc.memory_usage());
+    CHECK(1.5 == doc.get_arr().at(999).get_map().key("v").get_arr().at(0).get_double(0));
+    CHECK("s999" == doc.get_arr().at(999).get_map().key("v").get_arr().at(1).get_str(""));
+
+    // the memory is kept on error
+    REQUIRE_FALSE(p.parse(STR([1,2,xxx]), doc));
+    CHECK_FALSE(doc.ok());
+    CHECK(usage == doc.memory_usage());
+
+    // a shared arena is not reused
+    REQUIRE(p.parse(STR({"a":[1]}), doc));
+    j::Doc cloned(doc.clone());
+    REQUIRE(p.parse(STR({"b":[2]}), doc));
+    CHECK(STR({"a":[1]}) == d.dump(cloned));
+    CHECK(STR({"b":[2]}) == d.dump(doc));
+
+    // preallocated
+    j::Doc fresh;
+    fresh.reserve(20000, 200000);
+    usage = fresh.memory_usage();
+#if defined(__GLIBC__) && !defined(__SANITIZE_ADDRESS__)
+    mallocs = g_mallocs;
+#endif
+    ok = p.parse(input[0], fresh);
+#if defined(__GLIBC__) && !defined(__SANITIZE_ADDRESS__)
+    CHECK(mallocs == g_mallocs);
+#endif
+    CHECK(ok);
+    CHECK(usage == fresh.memory_usage());
+    fresh.clear();
+    CHECK(0 == fresh.memory_usage());
+}
+
+TEST_CASE("parser.borrow_input") {
+    j::Parser p;
+    j::Doc doc;
+    j::Dumper d;
+    std::string input = STR({"k":"val","e\"":"a\\b","a":["xy",""]});
+
+    REQUIRE(p.parse(input, doc));
+    j::MemoryStats copied = doc.memory_stats();
+    p.borrow_input = true;
+    REQUIRE(p.parse(input, doc));
+    CHECK(input == d.dump(doc));
+    j::MemoryStats borrowed = doc.memory_stats();
+    CHECK(copied.string_bytes == borrowed.string_bytes);
+    CHECK(copied.bytes > borrowed.bytes);
+
+    // the keys without escapes and the strings refer to the input, escaped ones until decoded
+    input[input.find("k")] = 'K';
+    input[input.find("val")] = 'V';
+    input[input.find("xy")] = 'X';
+    input[input.find("a\\\\b")] = 'A';
+    CHECK("Val" == doc.get_map().key("K").get_str(""));
+    CHECK("A\\b" == doc.get_map().key("e\"").get_str(""));
+    CHECK("Xy" == doc.get_map().key("a").get_arr().at(0).get_str(""));
+    CHECK("" == doc.get_map().key("a").get_arr().at(1).get_str("x"));
+    CHECK_FALSE(doc.get_map().key("k").ok());
+
+    // copied by shrink()
+    doc.shrink();
+    input[input.find("Xy")] = 'x';
+    CHECK("Xy" == doc.get_map().key("a").get_arr().at(0).get_str(""));
+    CHECK(STR({"K":"Val","e\"":"A\\b","a":["Xy",""]}) == d.dump(doc));
+
+    // keys of maps with and without shapes
+    input = "[";
+    for (int i = 0; i < 100; ++i) {
+        char buf[64];
+        snprintf(buf, sizeof(buf), "%s{\"id\":%d,\"k%d\":\"v\"}", i ? "," : "", i, i % 10);
+        input += buf;
+    }
+    input += "]";
+    REQUIRE(p.parse(input, doc));
+    CHECK(input == d.dump(doc));
+    CHECK("v" == doc.get_arr().at(99).get_map().key("k9").get_str(""));
+    j::MapResult m = doc.set_arr().at(0).set_map();
+    m.erase("k0");
+    m.key("k1").set_str("w");
+    CHECK(STR({"id":0,"k1":"w"}) == d.dump(doc.get_arr().at(0).clone()));
+}
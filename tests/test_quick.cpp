@@ -51,9 +51,15 @@ struct TmpFile {
 
 TEST_CASE("parse_file") {
     j::Doc doc;
-    TmpFile t1(STR({"a": 1}));
+    TmpFile t1(STR({"a": 1, "b": ["xyz"]}));
     CHECK(j::parse_file(t1.path.c_str(), doc));
     CHECK(j::get(doc, "/a", 0) == 1);
+    // the content is kept by doc
+    CHECK(!j::parse_file("/nonexistent", doc));
+    CHECK(j::parse_file(t1.path.c_str(), doc));
+    j::Doc cloned(doc.clone());
+    doc.clear();
+    CHECK(j::get(cloned, "/b/0", std::string()) == "xyz");
 }
 
 TEST_CASE("extract.scalar") {
@@ -191,6 +197,9 @@ TEST_CASE("set.scalar") {
     set(doc, "", (float)-INFINITY);
     CHECK(STR(-Infinity) == dumps(doc));
 
+    set(doc, "", 0.1f);
+    CHECK(STR(0.1) == dumps(doc));
+
     set(doc, "", std::string("asdf"));
     CHECK(STR("asdf") == dumps(doc));
 
@@ -2,7 +2,10 @@
 
 // system
 #include <cfloat>
+#include <clocale>
 #include <cmath>
+#include <cstdlib>
+#include <cstring>
 // proj
 #include "../j/j.h"
 
@@ -73,6 +76,37 @@ TEST_CASE("reader.clone") {
     CHECK(STR([1]) == d.dump(doc));
 }
 
+TEST_CASE("reader.materialize") {
+    // get_str() and get_number() materialize the text once, so a Doc is not safe to read from threads
+    j::Parser p;
+    j::Doc doc;
+    REQUIRE(p.parse(STR(["a string longer than the inline buffer", 1.5, {"key":0}]), doc));
+    j::ConstArrayResult arr = doc.get_arr();
+    size_t usage = doc.memory_usage();
+    j::Dumper().dump(doc);
+    CHECK(1.5 == arr.at(1).get_double(0));
+    CHECK(0 == arr.at(2).get_map().key("key").get_u64(1));
+    CHECK(usage == doc.memory_usage());
+
+    const std::string &str = arr.at(0).get_str("");
+    CHECK("a string longer than the inline buffer" == str);
+    CHECK(usage < doc.memory_usage());
+    usage = doc.memory_usage();
+    CHECK(&str == &arr.at(0).get_str(""));
+    CHECK("1.5" == arr.at(1).get_number(""));
+    j::ConstMapIterator it = arr.at(2).get_map().iter();
+    REQUIRE(it.next());
+    CHECK("key" == it.key());
+    CHECK(&str == &arr.at(0).get_str(""));
+
+    // the FrozenDoc readers do not modify it
+    j::FrozenDoc frozen;
+    REQUIRE(p.parse(STR(["a string longer than the inline buffer"]), frozen));
+    usage = frozen.memory_usage();
+    CHECK("a string longer than the inline buffer" == frozen.get_root().get_arr().at(0).get_str(""));
+    CHECK(usage == frozen.memory_usage());
+}
+
 TEST_CASE("reader.pointer") {
     j::Doc doc;
     j::Parser p;
@@ -382,3 +416,441 @@ TEST_CASE("reader.number") {
     REQUIRE(p.parse(STR(9223372036854775807.0), doc));
     CHECK(INT64_MAX == doc.get_i64(0));
 }
+
+TEST_CASE("reader.map.shape.distinct") {
+    // maps with distinct keys become dictionaries, the records after them still share the keys
+    std::string ids = "[";
+    std::string recs = "[";
+    for (int r = 0; r < 1000; ++r) {
+        ids += r ? ",{" : "{";
+        recs += r ? ",{" : "{";
+        for (int i = 0; i < 20; ++i) {
+            char key[64];
+            snprintf(key, sizeof(key), "%s\"u%d\":%d", i ? "," : "", r * 20 + i, i);
+            ids += key;
+            snprintf(key, sizeof(key), "%s\"k%d\":%d", i ? "," : "", i, i);
+            recs += key;
+        }
+        ids += "}";
+        recs += "}";
+    }
+    ids += "]";
+    recs += "]";
+
+    j::Parser p;
+    j::Doc doc;
+    REQUIRE(p.parse("[" + ids + "," + recs + "]", doc));
+    j::ConstArrayResult arr = doc.get_arr();
+    for (int r = 0; r < 1000; ++r) {
+        for (int i = 0; i < 20; ++i) {
+            char key[32];
+            snprintf(key, sizeof(key), "u%d", r * 20 + i);
+            CHECK(i == (int)arr.at(0).get_arr().at(r).get_map().key(key).get_u64(99));
+            snprintf(key, sizeof(key), "k%d", i);
+            CHECK(i == (int)arr.at(1).get_arr().at(r).get_map().key(key).get_u64(99));
+        }
+    }
+    CHECK(j::Dumper().dump(doc) == "[" + ids + "," + recs + "]");
+
+    j::Doc ids_doc;
+    j::Doc recs_doc;
+    REQUIRE(p.parse(ids, ids_doc));
+    REQUIRE(p.parse(recs, recs_doc));
+    size_t ids_usage = ids_doc.memory_usage();
+    size_t recs_usage = recs_doc.memory_usage();
+    CHECK(recs_usage * 2 < ids_usage);
+    // the records after the distinct keys take the same memory
+    CHECK(doc.memory_usage() < ids_usage + recs_usage + recs_usage / 4);
+}
+
+TEST_CASE("reader.map.index") {
+    // linear scan for small maps, hash table for large maps
+    for (int n = 1; n <= 1000; n *= 3) {
+        CAPTURE(n);
+        j::Doc doc;
+        j::MapResult m = doc.set_map();
+        char key[32];
+        for (int i = 0; i < n; ++i) {
+            snprintf(key, sizeof(key), "k%d", i);
+            m.key(key).set_u64(i);
+        }
+        CHECK(n == (int)doc.get_map().size());
+        for (int i = 0; i < n; ++i) {
+            snprintf(key, sizeof(key), "k%d", i);
+            CHECK(i == (int)doc.get_map().key(key).get_u64(99999));
+        }
+        CHECK_FALSE(doc.get_map().key("k").ok());
+        CHECK_FALSE(doc.get_map().key("").ok());
+
+        // erase the even keys
+        for (int i = 0; i < n; i += 2) {
+            snprintf(key, sizeof(key), "k%d", i);
+            CHECK(m.erase(key));
+            CHECK_FALSE(m.erase(key));
+        }
+        CHECK(n / 2 == (int)doc.get_map().size());
+        for (int i = 0; i < n; ++i) {
+            snprintf(key, sizeof(key), "k%d", i);
+            CHECK((i % 2 == 1) == doc.get_map().key(key).ok());
+        }
+
+        // insertion order
+        j::ConstMapIterator it = doc.get_map().iter();
+        for (int i = 1; i < n; i += 2) {
+            snprintf(key, sizeof(key), "k%d", i);
+            REQUIRE(it.next());
+            CHECK(key == it.key());
+        }
+        CHECK_FALSE(it.next());
+
+        // reinsert
+        m.key("k0").set_u64(0);
+        CHECK(0 == doc.get_map().key("k0").get_u64(99999));
+    }
+}
+
+TEST_CASE("reader.map.shape") {
+    // maps with the same keys share the keys, modifying one does not affect the others
+    for (int n = 1; n <= 100; n *= 4) {
+        CAPTURE(n);
+        std::string rec = "{";
+        for (int i = 0; i < n; ++i) {
+            char key[32];
+            snprintf(key, sizeof(key), "%s\"k%d\":%d", i ? "," : "", i, i);
+            rec += key;
+        }
+        rec += "}";
+        std::string input = "[" + rec + "," + rec + "," + rec + "," + rec + "]";
+
+        j::Parser p;
+        j::Doc doc;
+        j::Dumper d;
+        REQUIRE(p.parse(input, doc));
+        j::ArrayResult arr = doc.set_arr();
+        REQUIRE(4 == arr.size());
+        for (size_t r = 0; r < 4; ++r) {
+            for (int i = 0; i < n; ++i) {
+                char key[32];
+                snprintf(key, sizeof(key), "k%d", i);
+                CHECK(i == (int)doc.get_arr().at(r).get_map().key(key).get_u64(99999));
+            }
+        }
+
+        CHECK(arr.at(0).set_map().erase("k0"));
+        arr.at(1).set_map().key("new").set_u64(1);
+        arr.at(2).set_map().key("k0").set_u64(9);
+        arr.at(3).set_map().clear();
+        arr.at(3).set_map().key("k0").set_u64(0);
+
+        CHECK(n - 1 == (int)doc.get_arr().at(0).get_map().size());
+        CHECK_FALSE(doc.get_arr().at(0).get_map().key("k0").ok());
+        CHECK(n + 1 == (int)doc.get_arr().at(1).get_map().size());
+        CHECK(1 == doc.get_arr().at(1).get_map().key("new").get_u64(0));
+        CHECK(9 == doc.get_arr().at(2).get_map().key("k0").get_u64(0));
+        CHECK(1 == doc.get_arr().at(3).get_map().size());
+        for (size_t r = 1; r < 3; ++r) {
+            for (int i = 1; i < n; ++i) {
+                char key[32];
+                snprintf(key, sizeof(key), "k%d", i);
+                CHECK(i == (int)doc.get_arr().at(r).get_map().key(key).get_u64(99999));
+            }
+        }
+
+        // the key order
+        std::string out = d.dump(doc);
+        CHECK(out.find(rec.substr(0, rec.size() - 1) + ",\"new\":1}") != std::string::npos);
+    }
+}
+
+TEST_CASE("reader.number.binary") {
+    // integers are converted once and the text is restored, other numbers keep the text
+    j::Parser p;
+    j::Doc doc;
+    j::Dumper d;
+    const char *cases[] = {
+        "0", "-0", "1", "-1", "1.0", "1e2", "-1E+2", "0.5",
+        "9223372036854775807", "9223372036854775808", "-9223372036854775808", "-9223372036854775809",
+        "18446744073709551615", "18446744073709551616", "99999999999999999999", "100000000000000000000",
+    };
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); ++i) {
+        std::string input = cases[i];
+        CAPTURE(input);
+        REQUIRE(p.parse(input, doc));
+        CHECK(input == d.dump(doc));
+        CHECK(input == doc.get_number(""));
+        CHECK(strtod(input.c_str(), NULL) == doc.get_double(-1));
+
+        // the same after boxing and cloning
+        CHECK(input == d.dump(doc));
+        j::Doc copy(doc.clone());
+        CHECK(input == d.dump(copy));
+        CHECK(doc.get_u64(7) == copy.get_u64(7));
+        CHECK(doc.get_i64(7) == copy.get_i64(7));
+        CHECK(doc.get_double(7) == copy.get_double(7));
+    }
+
+    REQUIRE(p.parse(STR([18446744073709551615, -9223372036854775808, -0, 1e2]), doc));
+    j::ConstArrayResult arr = doc.get_arr();
+    CHECK(UINT64_MAX == arr.at(0).get_u64(0));
+    CHECK_FALSE(arr.at(0).is_i64());
+    CHECK(INT64_MIN == arr.at(1).get_i64(0));
+    CHECK_FALSE(arr.at(1).is_u64());
+    CHECK(0 == arr.at(2).get_i64(1));
+    CHECK_FALSE(arr.at(2).is_u64());
+    CHECK(100 == arr.at(3).get_u64(0));
+    // boxed
+    CHECK("18446744073709551615" == arr.at(0).get_number(""));
+    CHECK(UINT64_MAX == arr.at(0).get_u64(0));
+    CHECK("-9223372036854775808" == arr.at(1).get_number(""));
+    CHECK(INT64_MIN == arr.at(1).get_i64(0));
+}
+
+TEST_CASE("reader.number.strtod") {
+    j::Parser p;
+    j::Doc doc;
+    j::FrozenDoc frozen;
+    char buf[64];
+
+    // every binade, the min, the max and a random mantissa, printed with 17 and fewer digits
+    uint64_t x = 88172645463325252ULL;
+    for (uint64_t e = 0; e < 0x7ff; ++e) {
+        for (int k = 0; k < 3; ++k) {
+            x ^= x << 13;
+            x ^= x >> 7;
+            x ^= x << 17;
+            uint64_t mantissa = k == 0 ? 0 : (k == 1 ? (1ULL << 52) - 1 : x >> 12);
+            uint64_t bits = (e << 52) | mantissa;
+            double d;
+            memcpy(&d, &bits, sizeof(d));
+            for (int prec = 17; prec > 0; prec -= 4) {
+                snprintf(buf, sizeof(buf), "%.*g", prec, (x & 1) ? -d : d);
+                CAPTURE(buf);
+                REQUIRE(p.parse(buf, doc));
+                double expect = strtod(buf, NULL);
+                double got = doc.get_double(0);
+                CHECK(0 == memcmp(&expect, &got, sizeof(double)));
+                REQUIRE(p.parse(buf, frozen));
+                CHECK(expect == frozen.get_root().get_double(0));
+            }
+        }
+    }
+
+    // halfway cases, and the digits beyond 19 or 768 decide the rounding
+    const char *cases[] = {
+        "9007199254740993",
+        "9007199254740993.00000000000000000000000000000001",
+        "9007199254740994.99999999999999999999999999999999",
+        "9007199254740995",
+        "1.7976931348623157e308",
+        "1.7976931348623158e308",
+        "1.797693134862315807937289714053e308",
+        "2.2250738585072011e-308",
+        "4.9406564584124654e-324",
+        "2.4703282292062327e-324",
+        "2.4703282292062328e-324",
+        // the halfway between 0 and the min subnormal
+        "2.4703282292062327208828439643411068618252990130716238221279284125033775363510437593264991818081799618"
+        "9898282347722858865463328355177969898199387398005390939063150356595155702263922908583924491051844359"
+        "3180284993653615250031937045767824921936562366986365848075700158576926990370631192827955855133292783"
+        "4338409351978015531246597263579574622766465272827220056374006485499977096599470454020828166226237857"
+        "3934507363390079677619305775067401763246736009689513405355374585166611342237666786041621596804619144"
+        "6729184030053005753084904876539171138659164623952491262365388187963623937328042389101867234849766823"
+        "5089863388587925628302755995657524455507255189313690836254779186948667994968324049705821028513185451"
+        "396213837722826145437693412532098591327667236328125e-324",
+        "2.4703282292062327208828439643411068618252990130716238221279284125033775363510437593264991818081799618"
+        "9898282347722858865463328355177969898199387398005390939063150356595155702263922908583924491051844359"
+        "3180284993653615250031937045767824921936562366986365848075700158576926990370631192827955855133292783"
+        "4338409351978015531246597263579574622766465272827220056374006485499977096599470454020828166226237857"
+        "3934507363390079677619305775067401763246736009689513405355374585166611342237666786041621596804619144"
+        "6729184030053005753084904876539171138659164623952491262365388187963623937328042389101867234849766823"
+        "5089863388587925628302755995657524455507255189313690836254779186948667994968324049705821028513185451"
+        "396213837722826145437693412532098591327667236328125000000000000000000000000000000000000001e-324",
+        "1e-400",
+        "1e400",
+        "0.000000000000000000000000000000000000001e39",
+    };
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); ++i) {
+        CAPTURE(cases[i]);
+        REQUIRE(p.parse(cases[i], doc));
+        double expect = strtod(cases[i], NULL);
+        double got = doc.get_double(0);
+        CHECK(0 == memcmp(&expect, &got, sizeof(double)));
+    }
+
+    // not affected by the locale
+    if (setlocale(LC_NUMERIC, "de_DE.UTF-8")) {
+        REQUIRE(p.parse("[0.5, 1.25e2]", doc));
+        CHECK(0.5 == doc.get_arr().at(0).get_double(0));
+        CHECK(125 == doc.get_arr().at(1).get_double(0));
+        setlocale(LC_NUMERIC, "C");
+    }
+}
+
+TEST_CASE("reader.memory.stats") {
+    j::Parser p;
+    j::Doc doc;
+    CHECK(0 == doc.memory_usage());
+    CHECK(0 == doc.memory_stats().bytes);
+
+    REQUIRE(p.parse(STR({"a": [1, 2.5, "xyz", null, true, -3], "b": {"c": {}}}), doc));
+    j::MemoryStats st = doc.memory_stats();
+    CHECK(1 == st.nulls);
+    CHECK(1 == st.bools);
+    CHECK(3 == st.numbers);
+    CHECK(1 == st.strings);
+    CHECK(1 == st.arrays);
+    CHECK(3 == st.maps);
+    CHECK(3 == st.max_depth);
+    CHECK(3 + 3 == st.string_bytes);
+    CHECK(0 == st.tombstones);
+    CHECK(0 < st.bytes);
+    CHECK(st.bytes <= doc.memory_usage());
+
+    // subtree
+    j::MemoryStats sub = doc.get_map().key("b").memory_stats();
+    CHECK(2 == sub.maps);
+    CHECK(2 == sub.max_depth);
+    CHECK(1 == sub.string_bytes);
+    CHECK(sub.bytes < st.bytes);
+
+    // erased slots
+    j::MapResult m = doc.set_map();
+    CHECK(m.erase("a"));
+    st = doc.memory_stats();
+    CHECK(1 == st.tombstones);
+    CHECK(0 == st.strings);
+    CHECK(0 == st.arrays);
+
+    // the garbage is counted until shrink()
+    size_t used = doc.memory_usage();
+    doc.shrink();
+    CHECK(doc.memory_usage() <= used);
+    CHECK(0 == doc.memory_stats().tombstones);
+
+    // boxed strings
+    std::string big(1000, 'x');
+    doc.set_str(big);
+    size_t before = doc.memory_usage();
+    CHECK(big == doc.get_str(""));
+    CHECK(before + 1000 < doc.memory_usage());
+    CHECK(1000 == doc.memory_stats().string_bytes);
+
+    doc.clear();
+    CHECK(0 == doc.memory_usage());
+}
+
+TEST_CASE("reader.frozen") {
+    j::Parser p;
+    j::Dumper d;
+    j::Doc doc;
+    j::FrozenDoc frozen;
+    CHECK_FALSE(frozen.get_root().ok());
+    CHECK("" == d.dump(frozen));
+
+    const char *input = STR({
+        "n": null, "t": true, "f": false,
+        "u": 18446744073709551615, "i": -9223372036854775808, "d": 1.5, "e": 1e2, "z": -0,
+        "s": "a\u0000b", "a": [1, [], {}, [2, [3]], "x"],
+        "m": {"k": {"": 4}, "s~": 5, "s/": 6},
+        "dup": 1, "dup": 2
+    });
+    REQUIRE(p.parse(input, frozen));
+    REQUIRE(p.parse(input, doc));
+    CHECK(STR({"n":null,"t":true,"f":false,"u":18446744073709551615,"i":-9223372036854775808,"d":1.5,"e":1e2,"z":-0,)
+        STR("s":"a\u0000b","a":[1,[],{},[2,[3]],"x"],"m":{"k":{"":4},"s~":5,"s/":6},"dup":1,"dup":2})
+        == d.dump(frozen));
+    d.indent = 2;
+    REQUIRE(p.parse(d.dump(frozen), doc));
+    d.indent = 0;
+
+    // scalars
+    j::FrozenMapResult m = frozen.get_root().get_map();
+    REQUIRE(m.ok());
+    CHECK(13 == m.size());
+    CHECK(m.key("n").is_null());
+    CHECK(m.key("t").get_bool(false));
+    CHECK_FALSE(m.key("f").get_bool(true));
+    CHECK_FALSE(m.key("n").is_bool());
+    CHECK(18446744073709551615ULL == m.key("u").get_u64(0));
+    CHECK_FALSE(m.key("u").is_i64());
+    CHECK(INT64_MIN == m.key("i").get_i64(0));
+    CHECK_FALSE(m.key("i").is_u64());
+    CHECK("-9223372036854775808" == m.key("i").get_number(""));
+    CHECK(1.5 == m.key("d").get_double(0));
+    CHECK_FALSE(m.key("d").is_u64());
+    CHECK(100 == m.key("e").get_u64(0));
+    CHECK("1e2" == m.key("e").get_number(""));
+    CHECK("-0" == m.key("z").get_number(""));
+    CHECK(std::string("a\0b", 3) == m.key("s").get_str(""));
+    size_t len = 0;
+    CHECK(std::string("a\0b", 4) == std::string(m.key("s").get_str(&len), 4));
+    CHECK(3 == len);
+    CHECK(NULL == m.key("d").get_str(&len));
+    CHECK("def" == m.key("d").get_str("def"));
+    CHECK("def" == m.key("s").get_number("def"));
+    // the last duplicated key
+    CHECK(2 == m.key("dup").get_u64(0));
+    CHECK_FALSE(m.key("x").ok());
+    CHECK_FALSE(m.key("x").is_null());
+
+    // containers
+    j::FrozenArrayResult a = m.key("a").get_arr();
+    REQUIRE(a.ok());
+    CHECK(5 == a.size());
+    CHECK(1 == a.at(0).get_u64(0));
+    CHECK(0 == a.at(1).get_arr().size());
+    CHECK(0 == a.at(2).get_map().size());
+    CHECK(3 == a.at(3).get_arr().at(1).get_arr().at(0).get_u64(0));
+    CHECK("x" == a.at(4).get_str(""));
+    CHECK_FALSE(a.at(5).ok());
+    CHECK_FALSE(m.key("a").is_map());
+    CHECK_FALSE(m.key("m").is_arr());
+    CHECK(4 == m.point("/m/k/").get_u64(0));
+    CHECK(5 == m.point("/m/s~0").get_u64(0));
+    CHECK(6 == m.point("/m/s~1").get_u64(0));
+    CHECK(3 == m.point("/a/3/1/0").get_u64(0));
+    CHECK(m.point("").is_map());
+    CHECK_FALSE(m.point("/a/5").ok());
+    CHECK_FALSE(m.point("/a/x").ok());
+    CHECK_FALSE(m.point("/n/x").ok());
+    CHECK_FALSE(m.point("a").ok());
+
+    // iterators
+    std::string keys;
+    j::FrozenMapIterator mit = m.iter();
+    while (mit.next()) {
+        keys += mit.key() + ",";
+        CHECK(mit.value().ok());
+    }
+    CHECK("n,t,f,u,i,d,e,z,s,a,m,dup,dup," == keys);
+    CHECK_FALSE(mit.next());
+    CHECK("" == mit.key());
+    CHECK_FALSE(mit.value().ok());
+    std::string types;
+    j::FrozenArrayIterator ait = a.iter();
+    CHECK_FALSE(ait.value().ok());
+    while (ait.next()) {
+        j::FrozenNodeResult v = ait.value();
+        types += v.is_arr() ? 'a' : v.is_map() ? 'm' : v.is_str() ? 's' : 'n';
+    }
+    CHECK("namas" == types);
+    CHECK_FALSE(ait.next());
+    CHECK_FALSE(j::FrozenArrayIterator().next());
+    CHECK_FALSE(j::FrozenMapIterator().next());
+    CHECK_FALSE(j::FrozenMapResult().key("x").ok());
+    CHECK_FALSE(j::FrozenNodeResult().get_arr().iter().next());
+
+    // errors, and the buffers are reused
+    size_t usage = frozen.memory_usage();
+    CHECK(usage > 0);
+    REQUIRE_FALSE(p.parse(STR([1, 2, x]), frozen));
+    CHECK_FALSE(frozen.get_root().ok());
+    REQUIRE(p.parse(STR("s"), frozen));
+    CHECK("s" == frozen.get_root().get_str(""));
+    CHECK(usage == frozen.memory_usage());
+    p.recursion_limit = 3;
+    CHECK(p.parse(STR([[[]]]), frozen));
+    CHECK_FALSE(p.parse(STR([[[[]]]]), frozen));
+    frozen.clear();
+    CHECK(0 == frozen.memory_usage());
+}
@@ -36,6 +36,7 @@ static std::string read_file(const char *path) {
 TEST_CASE("JSONTestSuite.y") {
     j::Parser p;
     j::Doc doc;
+    j::FrozenDoc frozen;
     j::Dumper d;
     std::vector<std::string> y_files = glob_files("./submodules/JSONTestSuite/test_parsing/y_*.json");
     for (size_t i = 0; i < y_files.size(); ++i) {
@@ -50,24 +51,66 @@ TEST_CASE("JSONTestSuite.y") {
         REQUIRE(p.parse(d1, doc));
         std::string d2 = d.dump(doc);
         CHECK(d1 == d2);
+        // the same with FrozenDoc, which keeps the duplicated keys
+        REQUIRE(p.parse(input, frozen));
+        REQUIRE(p.parse(d.dump(frozen), doc));
+        CHECK(d1 == d.dump(doc));
+        // the same with the structural index
+        p.structural_index = true;
+        REQUIRE(p.parse(input, doc));
+        CHECK(d1 == d.dump(doc));
+        p.structural_index = false;
+        // the y_ cases are valid UTF-8
+        p.validate_string = true;
+        CHECK(p.parse(input, doc));
+        p.validate_string = false;
     }
 }
 
 TEST_CASE("JSONTestSuite.n") {
     j::Parser p;
     j::Doc doc;
+    j::FrozenDoc frozen;
     std::vector<std::string> n_files = glob_files("./submodules/JSONTestSuite/test_parsing/n_*.json");
     for (size_t i = 0; i < n_files.size(); ++i) {
         std::string input = read_file(n_files[i].c_str());
         CAPTURE(n_files[i]);
         CAPTURE(input);
         CHECK_FALSE(p.parse(input, doc));
+        CHECK_FALSE(p.parse(input, frozen));
+        p.structural_index = true;
+        CHECK_FALSE(p.parse(input, doc));
+        p.structural_index = false;
     }
 }
 
+// the i_ cases of the strings which are not valid UTF-8
+static bool is_invalid_utf8_case(const std::string &path) {
+    static const char *const names[] = {
+        "i_string_UTF-8_invalid_sequence.json",
+        "i_string_UTF8_surrogate_U+D800.json",
+        "i_string_invalid_utf-8.json",
+        "i_string_iso_latin_1.json",
+        "i_string_lone_utf8_continuation_byte.json",
+        "i_string_not_in_unicode_range.json",
+        "i_string_overlong_sequence_2_bytes.json",
+        "i_string_overlong_sequence_6_bytes.json",
+        "i_string_overlong_sequence_6_bytes_null.json",
+        "i_string_truncated-utf-8.json",
+    };
+    std::string name = path.substr(path.rfind('/') + 1);
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); ++i) {
+        if (name == names[i]) {
+            return true;
+        }
+    }
+    return false;
+}
+
 TEST_CASE("JSONTestSuite.i") {
     j::Parser p;
     j::Doc doc;
+    j::FrozenDoc frozen;
     j::Dumper d;
     std::vector<std::string> i_files = glob_files("./submodules/JSONTestSuite/test_parsing/i_*.json");
     for (size_t i = 0; i < i_files.size(); ++i) {
@@ -76,14 +119,32 @@ TEST_CASE("JSONTestSuite.i") {
         CAPTURE(input);
         bool ok = p.parse(input, doc);
         CAPTURE(ok);
+        std::string d1;
         if (ok) {
             // dump parse dump
-            std::string d1 = d.dump(doc);
+            d1 = d.dump(doc);
             CAPTURE(d1);
             REQUIRE(p.parse(d1, doc));
             std::string d2 = d.dump(doc);
             CHECK(d1 == d2);
         }
+        // the same with the structural index
+        p.structural_index = true;
+        CHECK(ok == p.parse(input, doc));
+        if (ok) {
+            CHECK(d1 == d.dump(doc));
+        }
+        p.structural_index = false;
+
+        // the invalid UTF-8 is rejected with validate_string
+        bool valid = ok && !is_invalid_utf8_case(i_files[i]);
+        p.validate_string = true;
+        CHECK(valid == p.parse(input, doc));
+        CHECK(valid == p.parse(input, frozen));
+        p.structural_index = true;
+        CHECK(valid == p.parse(input, doc));
+        p.structural_index = false;
+        p.validate_string = false;
         CHECK(true);
     }
 }
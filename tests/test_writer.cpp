@@ -2,6 +2,9 @@
 
 // system
 #include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 // proj
 #include "../j/j.h"
 
@@ -246,6 +249,78 @@ TEST_CASE("writer.nan.inf") {
     CHECK("-Infinity" == d.dump(doc));
 }
 
+TEST_CASE("writer.int.format") {
+    j::Doc doc;
+    j::Dumper d;
+    char buf[32];
+
+    CHECK("18446744073709551615" == (doc.set_u64(~uint64_t(0)), d.dump(doc)));
+    CHECK("-9223372036854775808" == (doc.set_i64(int64_t(uint64_t(1) << 63)), d.dump(doc)));
+    CHECK("0" == (doc.set_i64(0), d.dump(doc)));
+
+    // around the powers of 10
+    uint64_t pow10 = 1;
+    for (int i = 0; i < 20; ++i) {
+        for (uint64_t val = pow10 - 1; val <= pow10 + 1; ++val) {
+            snprintf(buf, sizeof(buf), "%llu", (unsigned long long)val);
+            doc.set_u64(val);
+            CHECK(buf == d.dump(doc));
+            snprintf(buf, sizeof(buf), "%lld", -(long long)val);
+            doc.set_i64(-(int64_t)val);
+            CHECK(buf == d.dump(doc));
+        }
+        pow10 *= 10;
+    }
+}
+
+TEST_CASE("writer.double.shortest") {
+    j::Doc doc;
+    j::Dumper d;
+
+    const char *cases[] = {
+        "0.1", "0.3", "1e+23", "5e-324", "1.7976931348623157e+308", "2.2250738585072014e-308",
+        "100", "10000000000000000", "1e+17", "0.0001", "1e-05", "-0", "123.456", "9007199254740992",
+    };
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); ++i) {
+        doc.set_double(strtod(cases[i], NULL));
+        CHECK(cases[i] == d.dump(doc));
+    }
+
+    doc.set_float(0.1f);
+    CHECK("0.1" == d.dump(doc));
+    doc.set_float(3.4028235e38f);
+    CHECK("3.4028235e+38" == d.dump(doc));
+    doc.set_float(1e-45f);
+    CHECK("1e-45" == d.dump(doc));
+
+    // round trip
+    uint64_t seed = 1;
+    for (int i = 0; i < 100000; ++i) {
+        seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+        uint64_t bits = seed;
+        if (i % 2) {
+            // exponents near 0
+            bits = (bits & 0x800fffffffffffffull) | (uint64_t(1023 + int(bits % 80) - 40) << 52);
+        }
+        double val = 0;
+        memcpy(&val, &bits, sizeof(val));
+        if (std::isfinite(val)) {
+            doc.set_double(val);
+            double back = strtod(d.dump(doc).c_str(), NULL);
+            REQUIRE(0 == memcmp(&back, &val, sizeof(val)));
+        }
+
+        uint32_t fbits = uint32_t(seed >> 32);
+        float fval = 0;
+        memcpy(&fval, &fbits, sizeof(fval));
+        if (std::isfinite(fval)) {
+            doc.set_float(fval);
+            float fback = strtof(d.dump(doc).c_str(), NULL);
+            REQUIRE(0 == memcmp(&fback, &fval, sizeof(fval)));
+        }
+    }
+}
+
 TEST_CASE("writer.set") {
     j::Doc ddst;
     j::Doc dsrc;
@@ -260,3 +335,471 @@ TEST_CASE("writer.set") {
 }
 
 // TODO: TEST_CASE("map.size")
+
+TEST_CASE("writer.map.tmp.node") {
+    j::Doc doc;
+    j::MapResult m = doc.set_map();
+    for (int n = 0; n < 20; ++n) {
+        char key[32];
+        snprintf(key, sizeof(key), "k%d", n);
+        // the tmp node is created once
+        CHECK(m.key("tmp").ok());
+        CHECK_FALSE(doc.get_map().key("tmp").ok());
+        m.key(key).set_u64(n);
+    }
+    CHECK(21 == doc.get_map().size());
+    m.key("tmp").set_u64(1);
+    CHECK(21 == doc.get_map().size());
+    CHECK(1 == doc.get_map().key("tmp").get_u64(0));
+
+    j::ConstMapIterator it = doc.get_map().iter();
+    REQUIRE(it.next());
+    CHECK("tmp" == it.key());
+}
+
+TEST_CASE("writer.map.compact") {
+    j::Dumper d;
+    for (int n = 1; n <= 100; n *= 10) {
+        CAPTURE(n);
+        j::Doc doc;
+        j::MapResult m = doc.set_map();
+        char key[32];
+        for (int i = 0; i < n; ++i) {
+            snprintf(key, sizeof(key), "k%d", i);
+            m.key(key).set_u64(i);
+        }
+        // churn on the same key, the erased slots are compacted
+        for (int r = 0; r < 1000; ++r) {
+            m.key("churn").set_u64(r);
+            CHECK(m.erase("churn"));
+            m.key("k0").set_u64(0);     // overwrite
+        }
+        CHECK(n == (int)doc.get_map().size());
+        for (int i = 0; i < n; ++i) {
+            snprintf(key, sizeof(key), "k%d", i);
+            CHECK(i == (int)doc.get_map().key(key).get_u64(99999));
+        }
+        CHECK_FALSE(doc.get_map().key("churn").ok());
+
+        // erase while iterating
+        j::MapIterator it = m.iter();
+        int i = 0;
+        while (it.next()) {
+            snprintf(key, sizeof(key), "k%d", i);
+            CHECK(key == it.key());
+            if (i % 2 == 0) {
+                CHECK(m.erase(key));
+            }
+            i++;
+        }
+        CHECK(n == i);
+        CHECK(n / 2 == (int)doc.get_map().size());
+
+        // explicit compaction preserves the order
+        std::string before = d.dump(doc);
+        m.compact();
+        CHECK(before == d.dump(doc));
+        m.key("last").set_null();
+        j::ConstMapIterator cit = doc.get_map().iter();
+        for (int i = 1; i < n; i += 2) {
+            snprintf(key, sizeof(key), "k%d", i);
+            REQUIRE(cit.next());
+            CHECK(key == cit.key());
+        }
+        REQUIRE(cit.next());
+        CHECK("last" == cit.key());
+        CHECK_FALSE(cit.next());
+
+        // shrink to a new arena
+        before = d.dump(doc);
+        doc.shrink();
+        CHECK(before == d.dump(doc));
+        CHECK(doc.get_map().key("last").is_null());
+    }
+
+    j::Doc doc;
+    doc.shrink();
+    CHECK_FALSE(doc.ok());
+}
+
+TEST_CASE("writer.array.capacity") {
+    j::Doc doc;
+    j::ArrayResult arr = doc.set_arr();
+    CHECK(0 == arr.capacity());
+    arr.reserve(100);
+    CHECK(100 == arr.capacity());
+    for (int i = 0; i < 10; ++i) {
+        arr.push_back().set_u64(i);
+    }
+    arr.reserve(5);
+    CHECK(100 == arr.capacity());
+    // the array is the last allocation
+    arr.shrink_to_fit();
+    CHECK(10 == arr.capacity());
+    arr.erase(0);
+    arr.shrink_to_fit();
+    CHECK(9 == arr.capacity());
+    for (int i = 0; i < 100; ++i) {
+        arr.push_back().set_i64(-i);
+    }
+    CHECK(109 == arr.size());
+    CHECK(109 <= arr.capacity());
+    for (int i = 1; i < 10; ++i) {
+        CHECK(i == (int)doc.get_arr().at(i - 1).get_u64(0));
+    }
+    for (int i = 0; i < 100; ++i) {
+        CHECK(-i == (int)doc.get_arr().at(i + 9).get_i64(0));
+    }
+
+    // not the last allocation
+    arr.reserve(200);
+    doc.set_arr().push_back().set_str("abc");
+    arr.shrink_to_fit();
+    CHECK(200 == arr.capacity());
+    CHECK(110 == doc.get_arr().size());
+    CHECK("abc" == doc.get_arr().at(109).get_str(""));
+
+    // parsed arrays have the exact size
+    j::Parser p;
+    j::Dumper d;
+    p.allow_extra_comma = true;
+    REQUIRE(p.parse(STR([[1, 2, ], [], [[3]], {"a": [4, 5, 6]}, ]), doc));
+    CHECK(4 == doc.set_arr().capacity());
+    CHECK(2 == doc.set_arr().at(0).set_arr().capacity());
+    CHECK(0 == doc.set_arr().at(1).set_arr().capacity());
+    CHECK(STR([[1,2],[],[[3]],{"a":[4,5,6]}]) == d.dump(doc));
+    CHECK(3 == doc.set_arr().at(3).set_map().key("a").set_arr().capacity());
+}
+
+TEST_CASE("writer.handles") {
+    j::Parser p;
+    j::Dumper d;
+    j::Doc doc;
+
+    // the handles follow the values moved by inserting keys
+    j::MapResult m = doc.set_map();
+    j::NodeResult a = m.key("a");
+    j::NodeResult b = m.key("b");
+    j::NodeResult c = m.key("c");
+    j::NodeResult e;
+    j::NodeResult dd = m.key("d");
+    e = m.key("e");
+    a.set_u64(1);
+    b.set_u64(2);
+    c.set_u64(3);
+    dd.set_u64(4);
+    e.set_u64(5);
+    CHECK(STR({"a":1,"b":2,"c":3,"d":4,"e":5}) == d.dump(doc));
+
+    // and by growing arrays, the nested containers too
+    j::ArrayResult arr = m.key("arr").set_arr();
+    j::NodeResult first = arr.push_back();
+    j::NodeResult copy(first);
+    j::MapResult inner = arr.push_back().set_map();
+    for (int i = 0; i < 100; ++i) {
+        char key[32];
+        snprintf(key, sizeof(key), "k%d", i);
+        m.key(key).set_u64(i);
+        arr.push_back().set_u64(i);
+    }
+    first.set_str("x");
+    inner.key("y").set_null();
+    CHECK("x" == doc.get_map().point("/arr/0").get_str(""));
+    CHECK(copy.is_str());
+    CHECK(doc.get_map().point("/arr/1/y").is_null());
+    CHECK(5 == e.get_u64(0));
+    arr.reserve(1000);
+    arr.shrink_to_fit();
+    first.set_u64(0);
+    CHECK(0 == doc.get_map().point("/arr/0").get_u64(1));
+
+    // the handles of the removed values are invalidated
+    arr.erase(0);
+    CHECK_FALSE(first.ok());
+    CHECK_FALSE(copy.ok());
+    first.set_u64(1);
+    inner.key("z").set_null();
+    CHECK(STR({"y":null,"z":null}) == d.dump(doc.get_map().point("/arr/0").clone()));
+    CHECK(m.erase("b"));
+    CHECK_FALSE(b.ok());
+    m.compact();
+    c.set_u64(30);
+    CHECK(30 == doc.get_map().key("c").get_u64(0));
+    arr.clear();
+    CHECK_FALSE(inner.ok());
+    m.clear();
+    CHECK_FALSE(a.ok());
+    CHECK_FALSE(arr.ok());
+
+    // and of a Doc cleared, parsed again or destroyed
+    a = doc.set_map().key("a");
+    REQUIRE(p.parse("[]", doc));
+    CHECK_FALSE(a.ok());
+    a = doc.set_arr().push_back();
+    doc.clear();
+    CHECK_FALSE(a.ok());
+    {
+        j::Doc tmp;
+        a = tmp.set_root();
+        CHECK(a.ok());
+    }
+    CHECK_FALSE(a.ok());
+    a.set_u64(1);
+}
+
+static std::string dump_node(j::ConstNodeResult node) {
+    j::Doc doc(node.clone());
+    return j::Dumper().dump(doc);
+}
+
+TEST_CASE("writer.cow") {
+    j::Parser p;
+    j::Dumper d;
+    j::Doc src;
+    REQUIRE(p.parse(STR({"a":[1,{"b":"x"}],"c":{"d":[2]}}), src));
+    const std::string orig = d.dump(src);
+
+    // clone shares the tree, either side is copied on write
+    j::Doc cloned(src.clone());
+    cloned.set_map().key("a").set_arr().push_back().set_u64(3);
+    cloned.set_map().point("/c/d/0").set_str("y");
+    CHECK(orig == d.dump(src));
+    CHECK(STR({"a":[1,{"b":"x"},3],"c":{"d":["y"]}}) == d.dump(cloned));
+    src.set_map().point("/a/1/b").set_null();
+    CHECK(STR({"a":[1,{"b":null}],"c":{"d":[2]}}) == d.dump(src));
+    CHECK(STR({"a":[1,{"b":"x"},3],"c":{"d":["y"]}}) == d.dump(cloned));
+
+    // set() shares the subtree, the source may be released
+    j::Doc dst;
+    {
+        j::Doc tmp;
+        REQUIRE(p.parse(STR({"t":{"u":["v"],"w":{}}}), tmp));
+        dst.set_map().key("p").set(tmp.get_map().key("t"));
+        dst.set_map().key("q").set(tmp.get_map().key("t"));
+        tmp.set_map().key("t").set_map().erase("u");
+        CHECK(STR({"t":{"w":{}}}) == d.dump(tmp));
+    }
+    CHECK(STR({"p":{"u":["v"],"w":{}},"q":{"u":["v"],"w":{}}}) == d.dump(dst));
+    dst.set_map().key("q").set_map().key("u").set_arr().clear();
+    dst.set_map().point("/p/w/x").set_bool(true);
+    CHECK(STR({"p":{"u":["v"],"w":{"x":true}},"q":{"u":[],"w":{}}}) == d.dump(dst));
+    CHECK("v" == dst.get_map().point("/p/u/0").get_str(""));
+
+    // sharing back would be a cycle of arenas, copied instead
+    src.set_map().key("z").set(dst.get_map().key("p"));
+    dst.set_map().key("r").set(src.get_map().key("z"));
+    dst.set_map().point("/r/u/0").set_u64(4);
+    CHECK(STR(["v"]) == dump_node(src.get_map().point("/z/u")));
+    CHECK(STR(["v"]) == dump_node(dst.get_map().point("/p/u")));
+    CHECK(STR([4]) == dump_node(dst.get_map().point("/r/u")));
+
+    // a subtree set into itself
+    dst.set_map().key("p").set_map().key("s").set(dst.get_root());
+    CHECK(STR({"u":["v"],"w":{"x":true}}) == dump_node(dst.get_map().point("/p/s/p")));
+    CHECK_FALSE(dst.get_map().point("/p/s/p/s").ok());
+
+    // shrink() drops the sharing
+    std::string before = d.dump(dst);
+    dst.shrink();
+    src.clear();
+    CHECK(before == d.dump(dst));
+
+    // the handles taken before sharing do not write to the other Doc
+    j::Doc doc;
+    REQUIRE(p.parse(STR({"a":1,"b":[1,2]}), doc));
+    j::MapResult root = doc.set_map();
+    j::NodeResult a = root.key("a");
+    j::NodeResult b1 = root.key("b").set_arr().at(1);
+    {
+        j::Doc snap(doc.clone());
+        a.set_u64(2);
+        b1.set_u64(3);
+        CHECK(STR({"a":2,"b":[1,3]}) == d.dump(doc));
+        CHECK(STR({"a":1,"b":[1,2]}) == d.dump(snap));
+    }
+    j::Doc other;
+    other.set_root().set(doc.get_root());
+    a.set_u64(99);
+    CHECK(STR({"a":99,"b":[1,3]}) == d.dump(doc));
+    CHECK(STR({"a":2,"b":[1,3]}) == d.dump(other));
+    j::Doc sub(root.key("b").detach());
+    b1.set_u64(4);
+    CHECK(STR([1,3]) == d.dump(sub));
+    // the handles of the source node are kept
+    a = j::NodeResult();
+    b1 = j::NodeResult();
+    j::Doc snap(doc.clone());
+    root.key("c").set_null();
+    CHECK(STR({"a":99,"b":null,"c":null}) == d.dump(doc));
+    CHECK(STR({"a":99,"b":null}) == d.dump(snap));
+}
+
+TEST_CASE("writer.cow.drop") {
+    j::Doc src;
+    {
+        j::ArrayResult arr = src.set_map().key("a").set_arr();
+        for (int i = 0; i < 10000; ++i) {
+            arr.push_back().set_u64(i);
+        }
+        src.set_map().key("b").set_null();
+    }
+    const size_t usage = src.memory_usage();
+
+    // the shared containers are released when overwritten or when the other Doc is gone,
+    // then the source is written in place
+    for (int k = 0; k < 7; ++k) {
+        {
+            j::Doc tmp;
+            tmp.set_root().set(src.get_root());
+            CHECK(tmp.memory_usage() < usage / 10);
+            if (k == 0) {
+                tmp.set_root().set_null();
+            } else if (k == 1) {
+                tmp.set_root().set_u64(1);
+            } else if (k == 2) {
+                tmp.set_root().set_arr();
+            } else if (k == 3) {
+                j::Doc other;
+                other.set_map().key("c").set_bool(true);
+                tmp.set_root().set(other.get_root());
+            } else if (k == 4) {
+                // one level copied, the children are released with it
+                tmp.set_map().key("c").set_bool(true);
+                tmp.set_map().erase("a");
+            } else if (k == 5) {
+                tmp.set_map().key("c").set_bool(true);
+            }
+        }
+        src.set_map().point("/a/0").set_i64(-k);
+        CHECK(src.memory_usage() == usage);
+    }
+
+    // only the handles under the shared node force a copy
+    j::NodeResult b = src.set_map().key("b");
+    {
+        j::Doc tmp;
+        tmp.set_root().set(src.get_map().key("a"));
+        CHECK(tmp.memory_usage() < usage / 10);
+        b.set_u64(2);
+    }
+    j::NodeResult a1 = src.set_map().point("/a/1");
+    {
+        j::Doc tmp;
+        tmp.set_root().set(src.get_map().key("a"));
+        CHECK(tmp.memory_usage() > usage / 2);
+        a1.set_u64(3);
+        CHECK(1 == tmp.get_arr().at(1).get_u64(0));
+    }
+    CHECK(3 == src.get_map().point("/a/1").get_u64(0));
+    CHECK(src.memory_usage() == usage);
+}
+
+TEST_CASE("writer.adopt") {
+    j::Parser p;
+    j::Dumper d;
+    j::Doc doc;
+    j::Doc part;
+    REQUIRE(p.parse(STR({"a":[1,2],"b":"x"}), part));
+    doc.set_map().key("id").set_u64(1);
+    size_t usage = doc.memory_usage() + part.memory_usage();
+
+    // the arena is merged
+    doc.set_map().key("p").adopt(part);
+    CHECK_FALSE(part.get_root().ok());
+    CHECK(0 == part.memory_usage());
+    CHECK(usage == doc.memory_usage());
+    doc.set_map().point("/p/a/-").set_u64(3);
+    doc.set_map().key("p").set_map().key("c").set_null();
+    CHECK(STR({"id":1,"p":{"a":[1,2,3],"b":"x","c":null}}) == d.dump(doc));
+
+    // rvalue, and a Doc with merged arenas
+    j::Doc outer;
+    REQUIRE(p.parse(STR([0]), outer));
+    outer.set_arr().push_back().adopt(j::Doc(doc.move()));
+    outer.set_arr().at(1).set_map().point("/p/a/0").set_str("y");
+    CHECK(STR([0,{"id":1,"p":{"a":["y",2,3],"b":"x","c":null}}]) == d.dump(outer));
+
+    // src is shared by a clone, the tree is shared instead
+    REQUIRE(p.parse(STR({"k":[4]}), part));
+    j::Doc cloned(part.clone());
+    outer.set_arr().at(0).adopt(part);
+    CHECK_FALSE(part.get_root().ok());
+    outer.set_arr().at(0).set_map().key("k").set_arr().at(0).set_u64(5);
+    CHECK(STR({"k":[4]}) == d.dump(cloned));
+    CHECK(STR([{"k":[5]},{"id":1,"p":{"a":["y",2,3],"b":"x","c":null}}]) == d.dump(outer));
+
+    // detach
+    j::Doc sub(outer.set_arr().at(1).set_map().key("p").detach());
+    CHECK(STR({"a":["y",2,3],"b":"x","c":null}) == d.dump(sub));
+    CHECK(STR([{"k":[5]},{"id":1,"p":null}]) == d.dump(outer));
+    sub.set_map().key("a").set_arr().erase(0);
+    outer.set_arr().clear();
+    CHECK(STR({"a":[2,3],"b":"x","c":null}) == d.dump(sub));
+    CHECK_FALSE(j::Doc(j::NodeResult().detach()).get_root().ok());
+
+    // adopting self is ignored
+    sub.set_map().key("b").adopt(sub);
+    CHECK(STR({"a":[2,3],"b":"x","c":null}) == d.dump(sub));
+}
+
+TEST_CASE("writer.allocator") {
+    j::Parser p;
+    j::Dumper d;
+    j::CountingAllocator counter;
+    {
+        j::Doc doc(&counter);
+        REQUIRE(p.parse(STR({"a":[1,2,"x\ty"],"b":{"c":1.5}}), doc));
+        CHECK(counter.count > 0);
+        CHECK(counter.bytes > doc.memory_usage());
+        size_t calls = counter.calls;
+
+        // writer, clone(), detach() and shrink() use the allocator of the source
+        doc.set_map().key("s").set_str(std::string(100000, 'x'));
+        CHECK(calls < counter.calls);
+        j::Doc cloned(doc.clone());
+        cloned.set_map().key("a").set_arr().push_back().set_null();
+        j::Doc sub(cloned.set_map().key("b").detach());
+        cloned.shrink();
+        doc.clear();
+        calls = counter.calls;
+        j::Doc plain;
+        plain.set_map().key("k").set_u64(1);
+        CHECK(calls == counter.calls);
+
+        // not merged across allocators
+        cloned.set_map().key("k").adopt(plain);
+        CHECK_FALSE(plain.get_root().ok());
+        CHECK(STR({"c":1.5}) == d.dump(sub));
+        CHECK("x\ty" == cloned.get_map().point("/a/2").get_str(""));
+        std::string prefix = "{\"a\":[1,2,\"x\\u0009y\",null],\"b\":null,\"s\":\"xxx";
+        CHECK(prefix == d.dump(cloned).substr(0, prefix.size()));
+        CHECK(1 == j::Doc(cloned.set_map().key("k").detach()).get_map().key("k").get_u64(0));
+
+        // FrozenDoc
+        j::FrozenDoc frozen(&counter);
+        size_t count = counter.count;
+        REQUIRE(p.parse(STR({"a":[1,2,"x\ty"]}), frozen));
+        CHECK(count + 2 == counter.count);
+        CHECK("x\ty" == frozen.get_root().get_map().key("a").get_arr().at(2).get_str(""));
+        frozen.clear();
+        CHECK(count == counter.count);
+    }
+    CHECK(0 == counter.count);
+    CHECK(0 == counter.bytes);
+    CHECK(100000 < counter.peak);
+
+    // the limit
+    j::CountingAllocator limited(j::malloc_allocator(), 20000);
+    j::Doc doc(&limited);
+    std::string input = "[";
+    for (int i = 0; i < 1000; ++i) {
+        input += i ? ",\"some text\"" : "\"some text\"";
+    }
+    input += "]";
+    CHECK_THROWS_AS(p.parse(input, doc), std::bad_alloc);
+    CHECK(limited.bytes <= 20000);
+    doc.clear();
+    CHECK(0 == limited.count);
+    REQUIRE(p.parse(STR([1,2]), doc));
+    CHECK(STR([1,2]) == d.dump(doc));
+}